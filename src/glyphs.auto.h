@@ -0,0 +1,15 @@
+#pragma once
+
+// generated by tools/glyph_atlas.py from MonospaceTypewriter_48.ttf; do not edit
+
+#define GLYPH_TIME_CHARS             "0123456789:."
+#define GLYPH_TIME_Y                    0
+#define GLYPH_TIME_W                    14
+#define GLYPH_TIME_H                    20
+#define GLYPH_TIME_BASELINE             19
+
+#define GLYPH_DAY_CHARS              "0123456789/.adefhimnorstuw"
+#define GLYPH_DAY_Y                     20
+#define GLYPH_DAY_W                     10
+#define GLYPH_DAY_H                     16
+#define GLYPH_DAY_BASELINE              14
@@ -1,8 +1,45 @@
 
 
 const DEFAULT_VALUE = '...';
-const LONGLAT_DECIMALS = 5;
+const LONGLAT_SCALE = 100000;
 const CHANCE_OF_RAIN_CUTOFF = 60;
+const CM_PER_FOOT = 30.48;
+const DECIKNOTS_PER_MPH = 8.68976;
+const CITY_LENGTH = 23;
+const BATCH_DEADLINE_MS = 20000;   // from the fix, which may take a while
+const HEDGE_MS = 4000;              // before asking the next provider as well
+const REQUEST_TIMEOUT_MS = 8000;    // so a chain of two still beats the deadline
+const QUEUE_LIMIT = 4;
+const ACK_TIMEOUT_MS = 5000;
+const RETRY_BASE_MS = 1000;
+const RETRY_MAX_MS = 30000;
+const SEND_ATTEMPTS = 6;
+const TIDE_BACK_MS = 12 * 60 * 60 * 1000;   // so the watch has a tide before now
+const TIDE_RANGE_HOURS = 7 * 24 + 12;
+const MS_PER_DAY = 86400000;
+const JULIAN_UNIX_EPOCH = 2440587.5;
+const JULIAN_2000 = 2451545.0;
+const SUN_HORIZON_DEG = -0.833;     // refraction plus the sun's radius
+const EARTH_TILT_DEG = 23.4397;
+const EARTH_RADIUS_M = 6371000;
+const POSITION_MAX_AGE_MS = 20 * 60 * 1000;
+const POSITION_TIMEOUT_MS = 60000;
+const POINT_MOVE_M = 2000;          // api.weather.gov grid cells are 2.5km
+const STATION_MOVE_M = 10000;
+// how long a response is good for when it doesn't say; max-age wins
+const SUNRISE_TTL_MS = 6 * 60 * 60 * 1000;
+const WUNDERGROUND_TTL_MS = 30 * 60 * 1000;
+const DARKSKY_TTL_MS = 15 * 60 * 1000;
+const POINT_TTL_MS = 7 * MS_PER_DAY;
+const FORECAST_TTL_MS = 60 * 60 * 1000;
+const HOURLY_TTL_MS = 30 * 60 * 1000;
+const STATION_TTL_MS = 30 * MS_PER_DAY;
+const TIDE_TTL_MS = 12 * 60 * 60 * 1000;
+const HTTP_CACHE_KEEP_MS = 2 * MS_PER_DAY;  // past expiry, for revalidation
+const PACK_EVERY_MS = 6 * 60 * 60 * 1000;   // a pack covers a day
+const PACK_POINTS = 4;              // here and three waypoints, as on the watch
+// battery percent at which the watch steps down to each power stage after full
+const POWER_PCT_DEFAULT = [50, 30, 20, 10];
 
 const URL_CONFIG = 'http://watch.danericweiner.com';
 const DARKSKY_HASH = '<darksky_api_key>';
@@ -14,14 +51,101 @@ const WIND_ALTERNATE = 'WIND_ALTERNATE';
 const SHOW_CITY = 'SHOW_CITY';
 const INVERT =  'INVERT';
 const UNITS_CELSIUS = 'UNITS_CELSIUS';
-
-const KEY_TIDE = 'KEY_TIDE';
-const KEY_WIND = 'KEY_WIND';
-const KEY_SUNSET = 'KEY_SUNSET';
-const KEY_TEMP = 'KEY_TEMP';
-const KEY_FORECAST = 'KEY_FORECAST';
-const KEY_LOCATION = 'KEY_LOCATION';
-const KEY_INVERT = 'KEY_INVERT';
+const WAYPOINTS = 'WAYPOINTS';              // "lat,lon;lat,lon"
+const POWER_LEVELS = 'POWER_LEVELS';        // "50,30,20,10"
+const PACK_SENT = 'PACK_SENT';
+const POSITION = 'POSITION';
+const NOAA_POINT = 'NOAA_POINT';
+const TIDE_STATION = 'TIDE_STATION';
+const HTTP_CACHE = 'HTTP_CACHE';            // key -> expiry of each entry
+const HTTP_CACHE_PREFIX = 'HTTP:';
+const TIMINGS = 'TIMINGS';                  // name -> [count, total ms, max ms]
+
+// each group goes to the watch from one provider; the first field says
+// whether an answer is any good
+const HEDGE_FIELDS = {temp: ['temp'], forecast: ['forecast', 'temp_hilo'],
+                      wind: ['wind_dkt', 'wind_deg'], city: ['city'], tides: ['tides']};
+const HEDGE_NOAA = {temp: 'noaa_hourly', forecast: 'noaa_forecast', wind: 'noaa_hourly',
+                    city: 'noaa_point', tides: 'noaa_tide'};
+const HEDGE_PROVIDERS = {noaa_point: callNOAAForCity, noaa_forecast: callNOAAForForecast,
+                         noaa_hourly: callNOAAForWeather, noaa_tide: callNOAAForTideStationId,
+                         wunderground: callWunderground, darksky: callDarkSky};
+
+// BEGIN GENERATED by tools/schema.py from messages.json; do not edit
+const KEY_REFRESH = 'KEY_REFRESH';
+const KEY_WEATHER = 'KEY_WEATHER';
+const KEY_SEQ = 'KEY_SEQ';
+const KEY_ACK = 'KEY_ACK';
+const KEY_TIDES = 'KEY_TIDES';
+const KEY_STATS = 'KEY_STATS';
+const KEY_PACK = 'KEY_PACK';
+
+const FORECAST_CHANCE = 128;
+
+const FLAG = {invert: 1};
+const FORECAST = ['clear', 'clouds', 'cloudy', 'rain', 'snow', 'sleet', 'storms', 'fog', 'hazy', 'haze', 'dust', 'smoke', 'hot', 'cold'];
+const POWER = ['full', 'short_spin', 'slow_refresh', 'slow_rows', 'clock_only'];
+const PRESENT = {flags: 1, sun: 2, wind: 4, temp: 8, temp_hilo: 16, forecast: 32, coords: 64, city: 128};
+const REFRESH = {tides: 1};
+
+// [name, type, offset, count, present group]
+const PACK_FIELDS = [
+    ['start', 'uint32', 0, 1, null],
+    ['point', 'uint8', 4, 1, null],
+    ['count', 'uint8', 5, 1, null],
+    ['lat_e5', 'int32', 6, 1, null],
+    ['lon_e5', 'int32', 10, 1, null],
+    ['wind_dkt', 'uint16', 14, 24, null],
+    ['wind_deg', 'uint16', 62, 24, null],
+    ['temp', 'int8', 110, 24, null],
+    ['forecast', 'uint8', 134, 24, null],
+];
+const PACK_SIZE = 158;
+
+// [name, type, offset, count, present group]
+const STATS_FIELDS = [
+    ['start', 'uint32', 0, 1, null],
+    ['msgs_in', 'uint16', 4, 1, null],
+    ['msgs_dropped', 'uint16', 6, 1, null],
+    ['sends_failed', 'uint16', 8, 1, null],
+    ['redraws', 'uint16', 10, 1, null],
+    ['prop_frames', 'uint16', 12, 1, null],
+    ['refreshes', 'uint16', 14, 1, null],
+    ['heap_free_min', 'uint32', 16, 1, null],
+    ['battery_pct', 'uint8', 20, 1, null],
+    ['power', 'uint8', 21, 1, null],
+    ['power_changes', 'uint16', 22, 1, null],
+    ['power_min', 'uint16', 24, 5, null],
+];
+const STATS_SIZE = 34;
+
+// [name, type, offset, count, present group]
+const TIDES_FIELDS = [
+    ['start', 'uint32', 0, 1, null],
+    ['count', 'uint8', 4, 1, null],
+    ['offset_min', 'uint16', 5, 32, null],
+    ['height_cm', 'int16', 69, 32, null],
+];
+const TIDES_SIZE = 133;
+
+// [name, type, offset, count, present group]
+const WEATHER_FIELDS = [
+    ['present', 'uint16', 0, 1, null],
+    ['flags', 'uint8', 2, 1, 'flags'],
+    ['power_pct', 'uint8', 3, 4, 'flags'],
+    ['sunrise_min', 'uint16', 7, 1, 'sun'],
+    ['sunset_min', 'uint16', 9, 1, 'sun'],
+    ['wind_dkt', 'uint16', 11, 1, 'wind'],
+    ['wind_deg', 'uint16', 13, 1, 'wind'],
+    ['temp', 'int8', 15, 1, 'temp'],
+    ['temp_hilo', 'int8', 16, 1, 'temp_hilo'],
+    ['forecast', 'uint8', 17, 1, 'forecast'],
+    ['lat_e5', 'int32', 18, 1, 'coords'],
+    ['lon_e5', 'int32', 22, 1, 'coords'],
+    ['city', 'char', 26, 24, 'city'],
+];
+const WEATHER_SIZE = 50;
+// END GENERATED
 
 var wunderground_api_key;
 var data_alternate;
@@ -30,23 +154,44 @@ var show_city;
 var invert;
 var units_celsius;
 
+// messages waiting for the watch's ack; the head is the one being sent
+var send_queue = [];
+var send_seq = Math.floor(Math.random() * 0xffff);
+var send_timer = null;
+var send_in_flight = false;
+
+// parsed responses from the http cache, so a hit costs no JSON.parse
+var http_memo = {};
+
+// what each step of a refresh took since the watch last sent its stats,
+// loaded from TIMINGS on first use
+var timings = null;
+
+// callbacks waiting on each request in flight, by cache key
+var http_waiting = {};
+
+// the refresh being collected, its generation, and whether one asked for
+// while it was had wanted tides it couldn't take
+var refresh_batch = null;
+var refresh_generation = 0;
+var refresh_again = false;
+
 var noaa_temp = DEFAULT_VALUE;   
 var noaa_hi_temp = DEFAULT_VALUE;
 
-// Listen for when the watchface is opened
-Pebble.addEventListener('ready', 
-  function(e) {
-    sendSwitches();
-    getLocation();
-  }
-);
-        
 // Listen for when an AppMessage is received
 Pebble.addEventListener('appmessage',
   function(e) {    
-    sendSwitches();
-    getLocation();
-    logging();
+    var payload = e.payload || {};
+    if (payload.hasOwnProperty(KEY_ACK)){
+        sendAcked(payload[KEY_ACK]);
+    }
+    if (payload.hasOwnProperty(KEY_STATS)){
+        sendTelemetry(unpackStruct(STATS_FIELDS, payload[KEY_STATS]));
+    }
+    if (payload.hasOwnProperty(KEY_REFRESH)){
+        refresh(payload[KEY_REFRESH] & REFRESH.tides);
+    }
   }                     
 );
 
@@ -58,8 +203,10 @@ Pebble.addEventListener('showConfiguration', function(e) {
     show_city = getFromStorage(SHOW_CITY, '', false);
     invert = getFromStorage(INVERT, '', false);
     units_celsius = getFromStorage(UNITS_CELSIUS, '', false);
+    var waypoints = getFromStorage(WAYPOINTS, '', false);
+    var power_levels = getFromStorage(POWER_LEVELS, POWER_PCT_DEFAULT.join(','), false);
 
-    Pebble.openURL(URL_CONFIG + '?prior_data_alternate=' + data_alternate + '&prior_api_key=' + wunderground_api_key + '&prior_wind_alternate=' + wind_alternate + '&prior_show_city=' + show_city + '&prior_invert=' + invert + '&prior_units_celsius=' + units_celsius);
+    Pebble.openURL(URL_CONFIG + '?prior_data_alternate=' + data_alternate + '&prior_api_key=' + wunderground_api_key + '&prior_wind_alternate=' + wind_alternate + '&prior_show_city=' + show_city + '&prior_invert=' + invert + '&prior_units_celsius=' + units_celsius + '&prior_waypoints=' + encodeURIComponent(waypoints) + '&prior_power_levels=' + encodeURIComponent(power_levels));
     });
 
 
@@ -72,90 +219,338 @@ Pebble.addEventListener('webviewclosed', function(e) {
     window.localStorage.setItem(SHOW_CITY, config_data.show_city);
     window.localStorage.setItem(INVERT, config_data.invert);
     window.localStorage.setItem(UNITS_CELSIUS, config_data.units_celsius);
+    if (config_data.hasOwnProperty('waypoints')){
+        window.localStorage.setItem(WAYPOINTS, config_data.waypoints);
+        window.localStorage.removeItem(PACK_SENT);
+    }
+    if (config_data.hasOwnProperty('power_levels')){
+        window.localStorage.setItem(POWER_LEVELS, config_data.power_levels);
+    }
 
     clearFields();
-    sendSwitches();
-    getLocation();
+    refresh(false, true);
   });
 
+// One refresh: every provider adds its fields to a single batch, which goes
+// to the watch as one AppMessage once they have all answered.  The tide table
+// covers a week, so it is only fetched when the watch asks for it.
+//
+// Asking again while a refresh is being collected joins that one: the tides
+// are added if the location isn't known yet, or fetched by one more refresh
+// when it's done.  supersede (the settings changed) starts a new generation
+// instead, and whatever the old one still gets back is dropped.
+function refresh(tides, supersede){
+    var current = refresh_batch;
+
+    if (current !== null && !current.flushed){
+        if (!supersede){
+            if (tides && !current.tides){
+                if (current.located){
+                    refresh_again = true;
+                } else {
+                    current.tides = true;
+                }
+            }
+            return;
+        }
+        tides = tides || current.tides;
+        current.flushed = true;
+        clearTimeout(current.timer);
+    }
+
+    refresh_again = false;
+    refresh_batch = newBatch(tides);
+    sendSwitches(refresh_batch);
+    getLocation(refresh_batch);
+}
+
 function clearFields(){
+    // every field present but unknown shows as DEFAULT_VALUE on the watch
     var dictionary = {};
-    dictionary[KEY_TIDE] = DEFAULT_VALUE + '/' + DEFAULT_VALUE + '  ' + DEFAULT_VALUE;
-    dictionary[KEY_SUNSET] = DEFAULT_VALUE + "  " + DEFAULT_VALUE;
-    dictionary[KEY_WIND] = DEFAULT_VALUE + ' ' + DEFAULT_VALUE;    
-    dictionary[KEY_TEMP] = DEFAULT_VALUE + '/' + DEFAULT_VALUE;
-    dictionary[KEY_FORECAST] = DEFAULT_VALUE;
-    dictionary[KEY_LOCATION] = DEFAULT_VALUE + ", " + DEFAULT_VALUE;
+    WEATHER_FIELDS.forEach(function(field){
+        var group = field[4];
+        if (group != null && group != 'flags' && group != 'city'){
+            dictionary[field[0]] = DEFAULT_VALUE;
+        }
+    });
     sendData(dictionary);
 }
 
-function logging() {
-    var accountToken = Pebble.getAccountToken();
-    var watchToken = Pebble.getWatchToken();
-    var url = URL_LOGGING + '?' + encodeURIComponent(accountToken + ', ' + watchToken);
-    
+// Every few hours the watch sends what it has counted; it goes to the log
+// with how long each step here took, and both start again.  The watch token
+// tells watches apart without saying whose they are.
+function sendTelemetry(stats) {
+    var report = {watch: Pebble.getWatchToken(), stats: stats, timings: timingsLoad()};
+    var url = URL_LOGGING + '?' + encodeURIComponent(JSON.stringify(report));
+
+    timings = {};
+    timingsSave();
+
     var xhReq = new XMLHttpRequest();
     xhReq.onload = function() {};
     xhReq.open("GET", url);
     xhReq.send();
 }
 
-function sendSwitches()
+function timingsLoad(){
+    if (timings === null){
+        try{
+            timings = JSON.parse(window.localStorage.getItem(TIMINGS)) || {};
+        } catch(err){
+            timings = {};
+        }
+    }
+    return timings;
+}
+
+// saved once a refresh is over rather than on every step
+function timingsSave(){
+    try{
+        window.localStorage.setItem(TIMINGS, JSON.stringify(timingsLoad()));
+    } catch(err){
+        // a full localStorage only loses the timings
+    }
+}
+
+function timing(name, since){
+    var ms = Date.now() - since;
+    var entry = timingsLoad()[name] || [0, 0, 0];
+    entry[0]++;
+    entry[1] += ms;
+    entry[2] = Math.max(entry[2], ms);
+    timings[name] = entry;
+}
+
+function sendSwitches(batch)
 {    
-    invert = getFromStorage(INVERT, 'false', false);
+    invert = getFromStorage(INVERT, 'false', true);
     var dictionary = {};
-    dictionary[KEY_INVERT] = invert;
-    sendData(dictionary);
+    dictionary.flags = invert ? FLAG.invert : 0;
+    dictionary.power_pct = powerLevels();
+    batchAdd(batch, dictionary);
+}
+
+// the configured step-down levels, or the defaults for any that aren't a
+// percentage
+function powerLevels()
+{
+    var levels = getFromStorage(POWER_LEVELS, '', false).split(',');
+
+    return POWER_PCT_DEFAULT.map(function(fallback, i){
+        var pct = parseInt(levels[i], 10);
+        return (pct >= 0 && pct <= 100) ? pct : fallback;
+    });
 }
 
-function getLocation()
+// A fix younger than POSITION_MAX_AGE_MS is reused without asking for a new
+// one; if a new one can't be had, the last one is better than nothing.
+function getLocation(batch)
 {
     var options = {
             enableHighAccuracy: true,
-            maximumAge: 0,
-            timeout: 60000
+            maximumAge: POSITION_MAX_AGE_MS,
+            timeout: POSITION_TIMEOUT_MS
           };
  
-    // http://stackoverflow.com/questions/3397585/navigator-geolocation-getcurrentposition-sometimes-works-sometimes-doesnt
-    // make a dummy call first since the second one usually works better
-    navigator.geolocation.getCurrentPosition(function(){
-        navigator.geolocation.getCurrentPosition(
-                locationSuccess,
-                locationError,
-                options
-        );
-    },locationError,options);
-}
-
-function locationError(err)
+    batchExpect(batch);
+
+    var cached = parseJSON(window.localStorage.getItem(POSITION));
+    var cached_pos = cached && {coords: {latitude: cached.lat, longitude: cached.lon}};
+
+    if (cached && Date.now() - cached.time < POSITION_MAX_AGE_MS){
+        locationSuccess(cached_pos, batch);
+        return;
+    }
+
+    var asked = Date.now();
+    var success = function(pos){
+        timing('fix', asked);
+        window.localStorage.setItem(POSITION, JSON.stringify(
+                {lat: pos.coords.latitude, lon: pos.coords.longitude, time: Date.now()}));
+        if (batchCurrent(batch)){
+            locationSuccess(pos, batch);
+        }
+    };
+    var error = function(err){
+        timing('fix_failed', asked);
+        if (!batchCurrent(batch)){
+            return;
+        } else if (cached){
+            locationSuccess(cached_pos, batch);
+        } else {
+            locationError(err, batch);
+        }
+    };
+
+    navigator.geolocation.getCurrentPosition(success, error, options);
+}
+
+function locationError(err, batch)
 {
     console.log('Error requesting location!');
+    batchDone(batch);
+}
+
+// What was looked up for a position, stored under key, stays good until we
+// are more than radius metres from where it was looked up.
+function nearCache(key, pos, radius){
+    var entry = parseJSON(window.localStorage.getItem(key));
+    if (entry === null || distanceMeters(entry.lat, entry.lon,
+            pos.coords.latitude, pos.coords.longitude) > radius){
+        return null;
+    }
+    return entry.value;
+}
+
+function nearRemember(key, pos, value){
+    window.localStorage.setItem(key, JSON.stringify(
+            {lat: pos.coords.latitude, lon: pos.coords.longitude, value: value}));
+}
+
+// great circle distance, haversine
+function distanceMeters(lat1, lon1, lat2, lon2){
+    var rad = Math.PI / 180;
+    var a = Math.pow(Math.sin((lat2 - lat1) * rad / 2), 2)
+            + Math.cos(lat1 * rad) * Math.cos(lat2 * rad)
+            * Math.pow(Math.sin((lon2 - lon1) * rad / 2), 2);
+    return 2 * EARTH_RADIUS_M * Math.asin(Math.min(1, Math.sqrt(a)));
 }
 
-function locationSuccess(pos){               
+function locationSuccess(pos, batch){               
     wunderground_api_key = getFromStorage(WUNDERGROUND_API_KEY, 'na', false);
     data_alternate = getFromStorage(DATA_ALTERNATE, 'false', true);
     wind_alternate = getFromStorage(WIND_ALTERNATE, 'false', true);
     show_city = getFromStorage(SHOW_CITY, 'false', true);
     units_celsius = getFromStorage(UNITS_CELSIUS, 'false', true);
+    batch.located = true;
+    batch.pos = pos;
+    batchDeadline(batch, BATCH_DEADLINE_MS);
 
     if(!show_city){
         var dictionary = {};
         getLatLong(pos, dictionary);
-        sendData(dictionary);    
+        batchAdd(batch, dictionary);    
     }
 
-    callSunriseSunset(pos);
+    getSunriseSunset(pos, batch);
 
-    if (data_alternate){        
-        callWunderground(pos);
-        if(wind_alternate){ callDarkSky(pos); }
-    } else {  
-        if(show_city){ callNOAAForCity(pos); }      
-        callNOAAForForecast(pos);
-        callNOAAForWeather(pos);
-        callNOAAForTideStationId(pos);
+    hedge(batch, pos, 'temp');
+    hedge(batch, pos, 'forecast');
+    hedge(batch, pos, 'wind');
+    if(show_city){ hedge(batch, pos, 'city'); }
+    if(batch.tides){ hedge(batch, pos, 'tides'); }
+
+    // the location itself was the last thing outstanding until now
+    batchDone(batch);
+}
+
+// The providers able to answer for group, best first: the configured one,
+// then whichever others we can ask.  Wunderground needs a key.
+function providerOrder(group){
+    var noaa = HEDGE_NOAA[group];
+    var order = data_alternate ? ['wunderground', noaa] : [noaa, 'wunderground'];
+
+    if (group == 'wind'){
+        order.splice(data_alternate && wind_alternate ? 0 : 1, 0, 'darksky');
     }
+    return order.filter(function(name){
+        return name != 'wunderground' || data_alternate
+                || (wunderground_api_key != 'na' && wunderground_api_key != '');
+    });
+}
+
+// Asks the first provider for group's fields; if it hasn't answered in
+// HEDGE_MS the next is asked too, and a failure or an answer without the
+// group's first field moves on straight away.  The first usable answer is
+// what the batch gets.  When none is, the first answer that came back, if
+// any, is sent as it is.
+function hedge(batch, pos, group){
+    var fields = HEDGE_FIELDS[group];
+    var order = providerOrder(group);
+    var asked = 0;
+    var answered = 0;
+    var settled = false;
+    var fallback = null;
+    var timer = null;
+    var started = Date.now();
+
+    var settle = function(dictionary){
+        var picked = {};
+        settled = true;
+        clearTimeout(timer);
+        fields.forEach(function(field){
+            if (dictionary && dictionary[field] !== undefined){
+                picked[field] = dictionary[field];
+            }
+        });
+        batchDone(batch, picked);
+    };
+
+    var ask = function(){
+        if (settled || asked >= order.length || !batchCurrent(batch)){
+            return;
+        }
+        var name = order[asked++];
+
+        clearTimeout(timer);
+        if (asked < order.length){
+            timer = setTimeout(ask, HEDGE_MS);
+        }
+        provide(batch, pos, name, function(dictionary){
+            answered++;
+            if (settled){
+                return;
+            }
+            if (dictionary && usable(dictionary[fields[0]])){
+                if (name != order[0]){
+                    timing('hedged:' + group, started);
+                }
+                settle(dictionary);
+                return;
+            }
+            fallback = fallback || dictionary;
+            ask();
+            if (!settled && answered == asked){
+                settle(fallback);
+            }
+        });
+    };
+
+    batchExpect(batch);
+    if (order.length == 0){
+        settle(null);
+        return;
+    }
+    ask();
+}
+
+// Runs provider name once per refresh however many groups ask for it; each
+// gets its dictionary, or null if it failed.
+function provide(batch, pos, name, callback){
+    var run = batch.providers[name];
+
+    if (!run){
+        run = batch.providers[name] = {answered: false, dictionary: null, waiting: []};
+        HEDGE_PROVIDERS[name](pos, batch, function(dictionary){
+            run.answered = true;
+            run.dictionary = dictionary;
+            run.waiting.forEach(function(waiter){ waiter(dictionary); });
+            run.waiting = [];
+        });
+    }
+    if (run.answered){
+        callback(run.dictionary);
+    } else {
+        run.waiting.push(callback);
+    }
+}
+
+// a parse that failed leaves DEFAULT_VALUE, or NaN once it's been scaled
+function usable(value){
+    if (value === undefined || value === null || value !== value){
+        return false;
+    }
+    return typeof value != 'string' || value.indexOf(DEFAULT_VALUE) != 0;
 }
 
 function getFromStorage(key, fallback, convertToBoolean){
@@ -170,55 +565,509 @@ function getFromStorage(key, fallback, convertToBoolean){
     return result;
 }
 
+// Queues a message for the watch.  Each carries a seq and is resent with
+// exponential backoff until the watch acks that seq, so a busy radio costs a
+// resend rather than a refetch.  A full queue folds new fields into the
+// newest waiting message; when only packs are waiting, the oldest of them
+// makes room and the packs go again with the next refresh.  The head may
+// be in flight, so it is left alone.
 function sendData(dictionary)
 {   
-    // Send to Pebble
-    Pebble.sendAppMessage(dictionary,
+    var entry = null;
+    var key;
+
+    if (send_queue.length >= QUEUE_LIMIT){
+        for (var i = send_queue.length - 1; i >= 1 && entry === null; i--){
+            if (!send_queue[i].pack){
+                entry = send_queue[i];
+            }
+        }
+        if (entry === null){
+            send_queue.splice(1, 1);
+            window.localStorage.removeItem(PACK_SENT);
+        }
+    }
+    if (entry === null){
+        send_seq = send_seq % 0xffff + 1;
+        entry = {seq: send_seq, dictionary: {}, attempts: 0, queued: Date.now()};
+        send_queue.push(entry);
+    }
+    for (key in dictionary){
+        entry.dictionary[key] = dictionary[key];
+    }
+    sendNext();
+}
+
+// A pack goes in a message of its own, and never has weather folded in.
+// One still waiting for the same point is replaced.  The queue bound holds
+// for packs too: with it full, false, and the pack waits for another round.
+function sendPack(pack)
+{
+    for (var i = 1; i < send_queue.length; i++){
+        if (send_queue[i].pack && send_queue[i].pack.point == pack.point){
+            send_queue[i].pack = pack;
+            return true;
+        }
+    }
+    if (send_queue.length >= QUEUE_LIMIT){
+        return false;
+    }
+    send_seq = send_seq % 0xffff + 1;
+    send_queue.push({seq: send_seq, pack: pack, attempts: 0, queued: Date.now()});
+    sendNext();
+    return true;
+}
+
+function sendNext(){
+    if (send_in_flight || send_queue.length === 0){
+        return;
+    }
+
+    var entry = send_queue[0];
+    var message = {};
+    message[KEY_SEQ] = entry.seq;
+    if (entry.pack){
+        message[KEY_PACK] = packStruct(PACK_FIELDS, PACK_SIZE, entry.pack);
+    } else {
+        message[KEY_WEATHER] = packStruct(WEATHER_FIELDS, WEATHER_SIZE, entry.dictionary);
+    }
+    if (!entry.pack && entry.dictionary.hasOwnProperty('tides')){
+        message[KEY_TIDES] = packStruct(TIDES_FIELDS, TIDES_SIZE, entry.dictionary.tides);
+    }
+
+    send_in_flight = true;
+    Pebble.sendAppMessage(message,
        function(e) {
-         console.log('Weather info sent to Pebble successfully!');
+         // delivered to the watch; now wait for the face to ack it
+         if (send_queue[0] === entry && send_timer === null){
+             send_timer = setTimeout(function(){ sendFailed(entry); }, ACK_TIMEOUT_MS);
+         }
        },
        function(e) {
          console.log('Error sending weather info to Pebble!');
+         sendFailed(entry);
        }
      );    
 }
 
+function sendAcked(seq){
+    if (send_queue.length === 0 || send_queue[0].seq != seq){
+        return;
+    }
+    clearTimeout(send_timer);
+    send_timer = null;
+    send_in_flight = false;
+    timing('send', send_queue.shift().queued);
+    sendNext();
+}
+
+function sendFailed(entry){
+    if (send_queue[0] !== entry){
+        return;
+    }
+    clearTimeout(send_timer);
+    send_timer = null;
+
+    entry.attempts++;
+    if (entry.attempts >= SEND_ATTEMPTS){
+        console.log('Giving up on message ' + entry.seq);
+        send_in_flight = false;
+        send_queue.shift();
+        sendNext();
+        return;
+    }
+
+    // send_in_flight stays set so nothing jumps the queue while backing off
+    var delay = Math.min(RETRY_MAX_MS, RETRY_BASE_MS * Math.pow(2, entry.attempts - 1));
+    send_timer = setTimeout(function(){
+        send_timer = null;
+        send_in_flight = false;
+        sendNext();
+    }, delay);
+}
+
+// Packs values (by field name) into the little-endian byte layout from
+// messages.json. A field's present group is flagged when the field is given;
+// anything that isn't a number is sent as unknown.  Fields with a count take
+// an array.
+function packStruct(fields, size, values){
+    var bytes = [];
+    var present = 0;
+    var i;
+
+    for (i = 0; i < size; i++){
+        bytes.push(0);
+    }
+
+    fields.forEach(function(field){
+        var name = field[0];
+        var group = field[4];
+        if (group != null && values.hasOwnProperty(name)){
+            present |= PRESENT[group];
+        }
+    });
+
+    fields.forEach(function(field){
+        var name = field[0];
+        var type = field[1];
+        var offset = field[2];
+        var count = field[3];
+        var value = (name == 'present') ? present : values[name];
+
+        if (type == 'char'){
+            var text = (typeof value == 'string') ? value : '';
+            for (i = 0; i < count - 1 && i < text.length; i++){
+                bytes[offset + i] = text.charCodeAt(i) & 0x7f;
+            }
+            return;
+        }
+
+        var width = parseInt(type.replace(/[a-z]/g, ''), 10) / 8;
+        var signed = type.charAt(0) == 'i';
+        var min = signed ? -Math.pow(2, width * 8 - 1) : 0;
+        var max = signed ? Math.pow(2, width * 8 - 1) - 1 : Math.pow(2, width * 8) - 1;
+        var items = (count > 1) ? (value instanceof Array ? value : []) : [value];
+
+        for (var j = 0; j < count; j++){
+            var item = items[j];
+            if (typeof item != 'number' || !isFinite(item)){
+                item = signed ? min : max;      // UNKNOWN_* on the watch
+            }
+            item = Math.max(min, Math.min(max, Math.round(item)));
+
+            for (i = 0; i < width; i++){
+                bytes[offset + j * width + i] = (item >>> (8 * i)) & 0xff;
+            }
+        }
+    });
+
+    return bytes;
+}
+
+// The other way, for the integer structs the watch sends: bytes back into
+// values by field name.
+function unpackStruct(fields, bytes){
+    var values = {};
+
+    fields.forEach(function(field){
+        var type = field[1];
+        var width = parseInt(type.replace(/[a-z]/g, ''), 10) / 8;
+        var items = [];
+
+        for (var j = 0; j < field[3]; j++){
+            var item = 0;
+            for (var i = width - 1; i >= 0; i--){
+                item = item * 256 + (bytes[field[2] + j * width + i] || 0);
+            }
+            if (type.charAt(0) == 'i' && item >= Math.pow(2, width * 8 - 1)){
+                item -= Math.pow(2, width * 8);
+            }
+            items.push(item);
+        }
+        values[field[0]] = field[3] > 1 ? items : items[0];
+    });
+
+    return values;
+}
+
+// A batch collects provider results for one refresh.  It is flushed as a
+// single message when nothing is outstanding or at the deadline, whichever
+// is first.  The deadline runs from the fix, so a slow one doesn't eat into
+// the providers' time.  Anything answering after the flush is collected
+// again and follows in one more message.
+function newBatch(tides){
+    var batch = {dictionary: {}, late: {}, pending: 0, flushed: false, timer: null,
+                 tides: !!tides, located: false, generation: ++refresh_generation,
+                 providers: {}};
+    // in case the fix never answers at all
+    batchDeadline(batch, POSITION_TIMEOUT_MS + BATCH_DEADLINE_MS);
+    return batch;
+}
+
+function batchDeadline(batch, ms){
+    clearTimeout(batch.timer);
+    batch.timer = setTimeout(function(){ flushBatch(batch); }, ms);
+}
+
+// false once a newer refresh has started; what it gets back is out of date
+function batchCurrent(batch){
+    return batch.generation == refresh_generation;
+}
+
+function batchExpect(batch){
+    batch.pending++;
+}
+
+function batchAdd(batch, dictionary){
+    if (!batchCurrent(batch)){
+        return;
+    }
+    var into = batch.flushed ? batch.late : batch.dictionary;
+    for (var key in dictionary){
+        into[key] = dictionary[key];
+    }
+}
+
+function batchDone(batch, dictionary){
+    if (!batchCurrent(batch)){
+        return;
+    }
+    batchAdd(batch, dictionary || {});
+    batch.pending--;
+    if (batch.pending <= 0){
+        flushBatch(batch);
+    }
+}
+
+function flushBatch(batch){
+    clearTimeout(batch.timer);
+    if (batch.flushed){
+        if (Object.keys(batch.late).length > 0){
+            sendData(batch.late);
+            batch.late = {};
+        }
+        return;
+    }
+    batch.flushed = true;
+    if (Object.keys(batch.dictionary).length > 0){
+        sendData(batch.dictionary);
+    }
+    // the stragglers get one more deadline
+    if (batch.pending > 0){
+        batchDeadline(batch, BATCH_DEADLINE_MS);
+    }
+    timingsSave();
+    if (batch.pos){
+        sendPacks(batch.pos);
+    }
+    if (refresh_again){
+        refresh(true);
+    }
+}
+
+// GETs url as JSON through a cache in localStorage, under key.  An entry is
+// fresh for the response's Cache-Control max-age, or ttl when it gives none;
+// after that it is revalidated with If-None-Match if the provider sent an
+// ETag.  onload gets the parsed response, or null when it isn't JSON.  A get
+// for a key already being fetched waits on that request, and a request that
+// hasn't answered in REQUEST_TIMEOUT_MS is aborted as an error.
+function cachedGet(url, key, ttl, onload, onerror){
+    var now = Date.now();
+    var memo = http_memo[key];
+    if (memo && memo.expires > now){
+        onload(memo.json);
+        return;
+    }
+
+    var entry = parseJSON(window.localStorage.getItem(HTTP_CACHE_PREFIX + key));
+    if (entry && entry.expires > now){
+        http_memo[key] = {json: parseJSON(entry.text), expires: entry.expires};
+        timing('parse', now);
+        onload(http_memo[key].json);
+        return;
+    }
+
+    if (http_waiting[key]){
+        http_waiting[key].push({onload: onload, onerror: onerror});
+        return;
+    }
+
+    var waiting = http_waiting[key] = [{onload: onload, onerror: onerror}];
+    var xhReq = new XMLHttpRequest();
+    var timer = null;
+    var endpoint = key.split(':')[0];       // each is timed on its own
+
+    var answer = function(json){
+        clearTimeout(timer);
+        delete http_waiting[key];
+        timing(json === undefined ? endpoint + '_failed' : endpoint, now);
+        waiting.forEach(function(waiter){
+            if (json === undefined){
+                waiter.onerror();
+            } else {
+                waiter.onload(json);
+            }
+        });
+    };
+
+    xhReq.onload = function() {
+        var text = this.responseText;
+        var expires = Date.now() + maxAge(this.getResponseHeader('Cache-Control'), ttl);
+
+        if (this.status == 304 && entry){
+            text = entry.text;
+        } else if (this.status != 200){
+            // an error body, such as api.weather.gov's problem+json, is no answer
+            answer(undefined);
+            return;
+        }
+
+        var parsing = Date.now();
+        var json = parseJSON(text);
+        timing('parse', parsing);
+        if (json !== null && expires > Date.now()){
+            http_memo[key] = {json: json, expires: expires};
+            httpCacheStore(key, {text: text, expires: expires,
+                                 etag: this.getResponseHeader('ETag') || (entry && entry.etag)});
+        }
+        answer(json);
+    };
+    xhReq.onerror = function() {
+        answer(undefined);
+    };
+
+    xhReq.open("GET", url);
+    if (entry && entry.etag){
+        xhReq.setRequestHeader('If-None-Match', entry.etag);
+    }
+    xhReq.send();
+
+    timer = setTimeout(function(){
+        xhReq.onload = xhReq.onerror = function() {};
+        xhReq.abort();
+        answer(undefined);
+    }, REQUEST_TIMEOUT_MS);
+}
+
+// milliseconds a response may be reused for, from its Cache-Control
+function maxAge(cacheControl, ttl){
+    if (!cacheControl){
+        return ttl;
+    }
+    if (/no-store|no-cache/.test(cacheControl)){
+        return 0;
+    }
+    var seconds = getFirstMatch(/max-age=([0-9]+)/, cacheControl);
+    return seconds !== "" ? parseInt(seconds, 10) * 1000 : ttl;
+}
+
+// Writes one entry and drops any that expired more than HTTP_CACHE_KEEP_MS
+// ago.  A full localStorage just means no caching.
+function httpCacheStore(key, entry){
+    var index = parseJSON(window.localStorage.getItem(HTTP_CACHE)) || {};
+    var now = Date.now();
+
+    for (var old in index){
+        if (index[old] + HTTP_CACHE_KEEP_MS < now){
+            window.localStorage.removeItem(HTTP_CACHE_PREFIX + old);
+            delete index[old];
+        }
+    }
+    index[key] = entry.expires;
+
+    try{
+        window.localStorage.setItem(HTTP_CACHE_PREFIX + key, JSON.stringify(entry));
+        window.localStorage.setItem(HTTP_CACHE, JSON.stringify(index));
+    } catch(err){
+        window.localStorage.removeItem(HTTP_CACHE_PREFIX + key);
+    }
+}
+
+// about a kilometre, so nearby positions share cache entries
+function coordKey(pos){
+    return pos.coords.latitude.toFixed(2) + ',' + pos.coords.longitude.toFixed(2);
+}
+
+// responses that aren't JSON parse to null, which the get* functions treat
+// like any other missing field
+function parseJSON(text){
+    try{
+        return JSON.parse(text);
+    } catch(err){
+        return null;
+    }
+}
+
 function getLatLong(pos,dictionary) {
     
     var lat = DEFAULT_VALUE;
     var long = DEFAULT_VALUE;        
     
     try{
-        lat = pos.coords.latitude.toFixed(LONGLAT_DECIMALS);
-        long = pos.coords.longitude.toFixed(LONGLAT_DECIMALS);
+        lat = Math.round(pos.coords.latitude * LONGLAT_SCALE);
+        long = Math.round(pos.coords.longitude * LONGLAT_SCALE);
     }
     catch(err){        
         lat = DEFAULT_VALUE;
         long = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_LOCATION] = lat + ", " + long;
+    dictionary.lat_e5 = lat;
+    dictionary.lon_e5 = long;
 }
 
-function callSunriseSunset(pos)
+// Sunrise and sunset are worked out here from the position, which needs no
+// data signal; the web service is only asked if that fails.
+function getSunriseSunset(pos, batch)
 {
-    var url = 'https://api.sunrise-sunset.org/json?lat=' + pos.coords.latitude + '&lng=' + pos.coords.longitude + '&date=today&formatted=0';               
-    
-    var xhReq = new XMLHttpRequest();
-    
-    xhReq.onload = function() {
-        
-        var dictionary = {}; 
-        var json = JSON.parse(this.responseText);        
+    var times = sunTimes(pos.coords.latitude, pos.coords.longitude, new Date());
+    if (times === null){
+        callSunriseSunset(pos, batch);
+        return;
+    }
 
-        getSunriseSunsetAstronomy(json,dictionary);        
-               
-        // send populated data
-        sendData(dictionary);
-    };
+    var dictionary = {};
+    dictionary.sunrise_min = times.sunrise === null ? DEFAULT_VALUE
+            : times.sunrise.getHours() * 60 + times.sunrise.getMinutes();
+    dictionary.sunset_min = times.sunset === null ? DEFAULT_VALUE
+            : times.sunset.getHours() * 60 + times.sunset.getMinutes();
+    batchAdd(batch, dictionary);
+}
+
+// The sunrise equation for the local day of date: a minute or so out away
+// from the poles.  Returns {sunrise, sunset} as Dates, both null when the
+// sun stays up or down all day, or null if the position is unusable.
+function sunTimes(latitude, longitude, date){
+    var rad = Math.PI / 180;
+
+    if (!isFinite(latitude) || !isFinite(longitude)){
+        return null;
+    }
+
+    // days since 2000 at the solar noon nearest local noon
+    var noon = new Date(date.getFullYear(), date.getMonth(), date.getDate(), 12);
+    var n = Math.round(noon.getTime() / MS_PER_DAY + JULIAN_UNIX_EPOCH - JULIAN_2000
+                       + longitude / 360);
+    var mean_noon = n - longitude / 360;
+
+    var anomaly = (357.5291 + 0.98560028 * mean_noon) % 360;
+    var center = 1.9148 * Math.sin(anomaly * rad) + 0.02 * Math.sin(2 * anomaly * rad)
+            + 0.0003 * Math.sin(3 * anomaly * rad);
+    var ecliptic = (anomaly + center + 180 + 102.9372) % 360;
+    var transit = JULIAN_2000 + mean_noon + 0.0053 * Math.sin(anomaly * rad)
+            - 0.0069 * Math.sin(2 * ecliptic * rad);
+
+    var declination = Math.asin(Math.sin(ecliptic * rad) * Math.sin(EARTH_TILT_DEG * rad));
+    var cos_hour = (Math.sin(SUN_HORIZON_DEG * rad) - Math.sin(latitude * rad) * Math.sin(declination))
+            / (Math.cos(latitude * rad) * Math.cos(declination));
+
+    if (!isFinite(cos_hour)){
+        return null;
+    }
+    if (cos_hour < -1 || cos_hour > 1){
+        return {sunrise: null, sunset: null};
+    }
+
+    var half_day = Math.acos(cos_hour) / rad / 360;
+    return {sunrise: new Date((transit - half_day - JULIAN_UNIX_EPOCH) * MS_PER_DAY),
+            sunset: new Date((transit + half_day - JULIAN_UNIX_EPOCH) * MS_PER_DAY)};
+}
+
+function callSunriseSunset(pos, batch)
+{
+    batchExpect(batch);
+
+    var url = 'https://api.sunrise-sunset.org/json?lat=' + pos.coords.latitude + '&lng=' + pos.coords.longitude + '&date=today&formatted=0';               
     
-    xhReq.open("GET", url);
-    xhReq.send();               
+    cachedGet(url, 'sunrise:' + coordKey(pos) + ':' + new Date().toDateString(), SUNRISE_TTL_MS,
+        function(json) {
+            var dictionary = {}; 
+            getSunriseSunsetAstronomy(json,dictionary);        
+            batchDone(batch, dictionary);
+        },
+        function() {
+            batchDone(batch);
+        });
 }
 
 function getSunriseSunsetAstronomy(json,dictionary) {
@@ -239,47 +1088,42 @@ function getSunriseSunsetAstronomy(json,dictionary) {
         }
 
         if ( sunset != null )
-            sunset = toTwelveHour(sunset.getHours()) + ":" + makeTwoDigit(sunset.getMinutes());
+            sunset = sunset.getHours() * 60 + sunset.getMinutes();
         
         if ( sunrise != null )
-            sunrise = toTwelveHour(sunrise.getHours()) + ":" + makeTwoDigit(sunrise.getMinutes());
+            sunrise = sunrise.getHours() * 60 + sunrise.getMinutes();
     }
     catch(err){
         sunset = DEFAULT_VALUE;
         sunrise = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_SUNSET] = sunrise + "  " + sunset;
+    dictionary.sunrise_min = sunrise;
+    dictionary.sunset_min = sunset;
 }
 
-function callWunderground(pos)
+function callWunderground(pos, batch, callback)
 {
     var url = 'http://api.wunderground.com/api/' + wunderground_api_key + '/geolookup/forecast/conditions/rawtide/tide/astronomy/q/' + pos.coords.latitude + ',' + pos.coords.longitude + '.json';               
     
-    var xhReq = new XMLHttpRequest();
-    
-    xhReq.onload = function() {
-        
-        var dictionary = {}; 
-        var json = JSON.parse(this.responseText);        
-        
-        getWundergroundTemperature(json,dictionary);                
-        getWundergroundTide(json,dictionary);
-        
-        if (!wind_alternate){
+    cachedGet(url, 'wunderground:' + coordKey(pos), WUNDERGROUND_TTL_MS,
+        function(json) {
+            var dictionary = {}; 
+
+            getWundergroundTemperature(json,dictionary);                
             getWundergroundWind(json,dictionary);
-        } 
-        
-        if (show_city){
-            getWundergroundCity(json,dictionary);
-        }
-        
-        // send populated data
-        sendData(dictionary);
-    };
-    
-    xhReq.open("GET", url);
-    xhReq.send();               
+            if (batch.tides){
+                getWundergroundTide(json,dictionary);
+            }
+            if (show_city){
+                getWundergroundCity(json,dictionary);
+            }
+
+            callback(dictionary);
+        },
+        function() {
+            callback(null);
+        });
 }
 
 function getWundergroundTemperature(json,dictionary) {
@@ -329,41 +1173,57 @@ function getWundergroundTemperature(json,dictionary) {
         hi_temp = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_TEMP] = temp + '/' + hi_temp;
-    dictionary[KEY_FORECAST] = weather;
+    dictionary.temp = temp;
+    dictionary.temp_hilo = hi_temp;
+    dictionary.forecast = forecastCode(weather);
 }
 
 function getWundergroundTide(json,dictionary) {
 
-    var tide_height = DEFAULT_VALUE;
-    var next_tide_height = DEFAULT_VALUE;
-    var next_tide_time = DEFAULT_VALUE;
-    
+    var events = [];
+
     try{
-        if (json.rawtide.rawTideObs[0] != null)
-            tide_height = Math.round(json.rawtide.rawTideObs[0].height);
-        
         var tideSummary = json.tide.tideSummary;
 
-        for (i = 0; i < tideSummary.length; i++)
+        for (var i = 0; i < tideSummary.length; i++)
         {        
             if (tideSummary[i].data.type.localeCompare('Low Tide') == 0
                     || tideSummary[i].data.type.localeCompare('High Tide') == 0)
 
             {
-                next_tide_time = toTwelveHour(tideSummary[i].date.hour) + ":" + tideSummary[i].date.min;
-                next_tide_height = Math.round(tideSummary[i].data.height.split(" ")[0]);
-                break;
+                events.push({time: parseInt(tideSummary[i].date.epoch, 10) * 1000,
+                             cm: parseFloat(tideSummary[i].data.height.split(" ")[0]) * CM_PER_FOOT});
             }              
         }
     }
     catch(err){
-        tide_height = DEFAULT_VALUE;
-        next_tide_time = DEFAULT_VALUE;
-        next_tide_height = DEFAULT_VALUE;
+        events = [];
+    }
+
+    if (events.length > 0){
+        dictionary.tides = tideTable(events);
     }
-    
-    dictionary[KEY_TIDE] = tide_height + '/' + next_tide_height + '  ' + next_tide_time;
+}
+
+// High and low tides, [{time (ms), cm}] oldest first, as the tides struct.
+// Anything past what the struct holds is dropped.
+function tideTable(events){
+    var limit = 0;
+    TIDES_FIELDS.forEach(function(field){
+        if (field[0] == 'offset_min'){
+            limit = field[3];
+        }
+    });
+
+    var start = Math.floor(events[0].time / 60000) * 60;
+    var table = {start: start, count: 0, offset_min: [], height_cm: []};
+
+    for (var i = 0; i < events.length && i < limit; i++){
+        table.offset_min.push(Math.round((events[i].time / 1000 - start) / 60));
+        table.height_cm.push(events[i].cm);
+        table.count++;
+    }
+    return table;
 }
 
 function getWundergroundWind(json,dictionary) {
@@ -373,17 +1233,18 @@ function getWundergroundWind(json,dictionary) {
     
     try{        
         if (json.current_observation.wind_mph != null)
-            wind_mph = Math.round(json.current_observation.wind_mph);
+            wind_mph = json.current_observation.wind_mph;
 
         if (json.current_observation.wind_dir != null)
-            wind_dir = json.current_observation.wind_dir.toLowerCase();
+            wind_dir = compassToDegrees(json.current_observation.wind_dir);
     }
     catch(err){        
         wind_mph = DEFAULT_VALUE;
         wind_dir = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_WIND] = wind_mph + ' ' + wind_dir;
+    dictionary.wind_dkt = wind_mph * DECIKNOTS_PER_MPH;
+    dictionary.wind_deg = wind_dir;
 }
 
 function getWundergroundCity(json,dictionary) {
@@ -403,29 +1264,23 @@ function getWundergroundCity(json,dictionary) {
         state = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_LOCATION] = city + ", " + state;
+    dictionary.city = (city + ", " + state).substring(0, CITY_LENGTH);
 }
 
-function callDarkSky(pos)
+function callDarkSky(pos, batch, callback)
 {        
     // use my api key for now    
     var url = 'https://api.darksky.net/forecast/' + DARKSKY_HASH + '/' + pos.coords.latitude + ','+ pos.coords.longitude + '?exclude=minutely,hourly,daily,alerts,flags';         
     
-    var xhReq = new XMLHttpRequest();
-    
-    xhReq.onload = function() {
-        
-        var dictionary = {}; 
-        var json = JSON.parse(this.responseText);        
-        
-        getDarkSkyWind(json,dictionary); 
-        
-        // send populated data
-        sendData(dictionary);
-    };
-    
-    xhReq.open("GET", url);
-    xhReq.send();            
+    cachedGet(url, 'darksky:' + coordKey(pos), DARKSKY_TTL_MS,
+        function(json) {
+            var dictionary = {}; 
+            getDarkSkyWind(json,dictionary); 
+            callback(dictionary);
+        },
+        function() {
+            callback(null);
+        });
 }
 
 function getDarkSkyWind(json,dictionary) {
@@ -435,38 +1290,62 @@ function getDarkSkyWind(json,dictionary) {
     
     try{       
         if (json.currently.windSpeed != null)
-            wind_mph = Math.round(json.currently.windSpeed);
+            wind_mph = json.currently.windSpeed;
 
         if (json.currently.windBearing != null)            
-            wind_dir = degToCompass(json.currently.windBearing).toLowerCase();
+            wind_dir = json.currently.windBearing;
     }
     catch(err){        
         wind_mph = DEFAULT_VALUE;
         wind_dir = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_WIND] = wind_mph + ' ' + wind_dir;
+    dictionary.wind_dkt = wind_mph * DECIKNOTS_PER_MPH;
+    dictionary.wind_deg = wind_dir;
 }
 
-function callNOAAForCity(pos)
+// The api.weather.gov point for pos: its forecast urls and nearest city.
+// Looked up again only once we've moved POINT_MOVE_M.
+function getNOAAPoint(pos, callback)
 {
-    var url = 'https://api.weather.gov/points/' + pos.coords.latitude + ',' + pos.coords.longitude + '';               
-    
-    var xhReq = new XMLHttpRequest();
-    
-    xhReq.onload = function() {
-        
-        var dictionary = {}; 
-        var json = JSON.parse(this.responseText);        
+    var base = 'https://api.weather.gov/points/' + pos.coords.latitude + ',' + pos.coords.longitude;
+    var point = nearCache(NOAA_POINT, pos, POINT_MOVE_M);
 
-        getNOAACity(json, dictionary);
-                
-        // send populated data
-        sendData(dictionary);
-    };
-    
-    xhReq.open("GET", url);
-    xhReq.send();               
+    if (point !== null){
+        callback(point);
+        return;
+    }
+
+    // without the point the old per-position urls still work
+    var fallback = {forecast: base + '/forecast', hourly: base + '/forecast/hourly',
+                    city: DEFAULT_VALUE + ", " + DEFAULT_VALUE};
+
+    cachedGet(base, 'point:' + coordKey(pos), POINT_TTL_MS,
+        function(json) {
+            var dictionary = {}; 
+
+            getNOAACity(json, dictionary);
+            try{
+                point = {forecast: json.properties.forecast,
+                         hourly: json.properties.forecastHourly,
+                         city: dictionary.city};
+            }
+            catch(err){
+                point = null;
+            }
+
+            if (point !== null && point.forecast && point.hourly){
+                nearRemember(NOAA_POINT, pos, point);
+            } else {
+                point = fallback;
+                point.city = dictionary.city;
+            }
+
+            callback(point);
+        },
+        function() {
+            callback(fallback);
+        });
 }
 
 function getNOAACity(json, dictionary) {
@@ -486,56 +1365,48 @@ function getNOAACity(json, dictionary) {
         state = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_LOCATION] = city + ", " + state;
+    dictionary.city = (city + ", " + state).substring(0, CITY_LENGTH);
 }
 
-function callNOAAForForecast(pos)
+function callNOAAForCity(pos, batch, callback)
 {
-    var url = 'https://api.weather.gov/points/' + pos.coords.latitude + ',' + pos.coords.longitude + '/forecast';               
-    
-    var xhReq = new XMLHttpRequest();
-    
-    xhReq.onload = function() {
-        
-        var dictionary = {}; 
-        var json = JSON.parse(this.responseText);        
-        
-        getNOAAForecast(json,dictionary);                
-               
-        // send populated data
-        sendData(dictionary);
-    };
-    
-    xhReq.open("GET", url);
-    xhReq.send();               
+    getNOAAPoint(pos, function(point){
+        callback({city: point.city});
+    });
+}
+
+function callNOAAForForecast(pos, batch, callback)
+{
+    getNOAAPoint(pos, function(point){
+        var url = point.forecast;
+
+        cachedGet(url, 'forecast:' + url, FORECAST_TTL_MS,
+            function(json) {
+                var dictionary = {}; 
+                getNOAAForecast(json,dictionary);                
+                callback(dictionary);
+            },
+            function() {
+                callback(null);
+            });
+    });
 }
 
 function getNOAAForecast(json,dictionary) {
 
     var weather = DEFAULT_VALUE;
 
-    try{                
-        if ( json.properties.periods[0].icon){ 
-            var iconString = json.properties.periods[0].icon;  
-            var weatherAndPercentage = getFirstMatch(/\/([\w,]+)(?:\?|$)/, iconString);     // weather,percentage in between / and ? or end of line
-            var weather = getFirstMatch(/(\w+)(?:,|$)/, weatherAndPercentage);              // weather before comma or end of line       
-            var percentage = getFirstMatch(/,([0-9]+)/, weatherAndPercentage);              // percentage after comma 
-            var questionMark = '';
-            if (percentage != ""){
-                percentage = parseFloat(percentage);
-                if(showNOAAQuestionMark(weather) && percentage < CHANCE_OF_RAIN_CUTOFF){
-                    questionMark = '?';
-                }
-            }
-
-            weather = noaaWeatherString(weather) + questionMark;            
+    try{
+        var period = currentPeriod(json);
+        if ( period.icon){ 
+            weather = noaaIconWeather(period.icon);
         }     
 
-        if( json.properties.periods[0].temperature != null){
+        if( period.temperature != null){
             if(units_celsius){
-                noaa_hi_temp = Math.round(FtoC(json.properties.periods[0].temperature));    
+                noaa_hi_temp = Math.round(FtoC(period.temperature));    
             } else{
-                noaa_hi_temp = Math.round(json.properties.periods[0].temperature);    
+                noaa_hi_temp = Math.round(period.temperature);    
             }
         }       
     }
@@ -544,40 +1415,66 @@ function getNOAAForecast(json,dictionary) {
         noaa_hi_temp = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_TEMP] = noaa_temp + '/' + noaa_hi_temp;
-    dictionary[KEY_FORECAST] = weather;
+    dictionary.temp = noaa_temp;
+    dictionary.temp_hilo = noaa_hi_temp;
+    dictionary.forecast = forecastCode(weather);
 }
 
-function callNOAAForWeather(pos)
+// the weather string for a NOAA icon url, with a ? for a low chance
+function noaaIconWeather(iconString){
+    var weatherAndPercentage = getFirstMatch(/\/([\w,]+)(?:\?|$)/, iconString);     // weather,percentage in between / and ? or end of line
+    var weather = getFirstMatch(/(\w+)(?:,|$)/, weatherAndPercentage);              // weather before comma or end of line       
+    var percentage = getFirstMatch(/,([0-9]+)/, weatherAndPercentage);              // percentage after comma 
+    var questionMark = '';
+    if (percentage != ""){
+        percentage = parseFloat(percentage);
+        if(showNOAAQuestionMark(weather) && percentage < CHANCE_OF_RAIN_CUTOFF){
+            questionMark = '?';
+        }
+    }
+
+    return noaaWeatherString(weather) + questionMark;
+}
+
+function callNOAAForWeather(pos, batch, callback)
 {
-    var url = 'https://api.weather.gov/points/' + pos.coords.latitude + ',' + pos.coords.longitude + '/forecast/hourly';               
-    
-    var xhReq = new XMLHttpRequest();
-    
-    xhReq.onload = function() {
-        
-        var dictionary = {}; 
-        var json = JSON.parse(this.responseText);        
-        
-        getNOAATemperature(json,dictionary);                
-        getNOAAWind(json,dictionary);
-               
-        // send populated data
-        sendData(dictionary);
-    };
-    
-    xhReq.open("GET", url);
-    xhReq.send();               
+    getNOAAPoint(pos, function(point){
+        var url = point.hourly;
+
+        cachedGet(url, 'hourly:' + url, HOURLY_TTL_MS,
+            function(json) {
+                var dictionary = {}; 
+                getNOAATemperature(json,dictionary);                
+                getNOAAWind(json,dictionary);
+                callback(dictionary);
+            },
+            function() {
+                callback(null);
+            });
+    });
+}
+
+// the period covering now; a cached response may start with one that's over
+function currentPeriod(json){
+    var periods = json.properties.periods;
+    var now = Date.now();
+    for (var i = 0; i < periods.length; i++){
+        if (new Date(periods[i].endTime).getTime() > now){
+            return periods[i];
+        }
+    }
+    return periods[0];
 }
 
 function getNOAATemperature(json,dictionary) {
      
     try{
-        if ( json.properties.periods[0].temperature != null){
+        var period = currentPeriod(json);
+        if ( period.temperature != null){
             if(units_celsius){
-                noaa_temp = Math.round(FtoC(json.properties.periods[0].temperature));    
+                noaa_temp = Math.round(FtoC(period.temperature));    
             } else{
-                noaa_temp = Math.round(json.properties.periods[0].temperature);    
+                noaa_temp = Math.round(period.temperature);    
             }
         }                      
     }
@@ -585,7 +1482,8 @@ function getNOAATemperature(json,dictionary) {
         noaa_temp = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_TEMP] = noaa_temp + '/' + noaa_hi_temp;
+    dictionary.temp = noaa_temp;
+    dictionary.temp_hilo = noaa_hi_temp;
 }
 
 function getNOAAWind(json,dictionary) {
@@ -593,82 +1491,188 @@ function getNOAAWind(json,dictionary) {
     var wind_mph = DEFAULT_VALUE;
     var wind_dir = DEFAULT_VALUE;
     
-    try{        
-        if (json.properties.periods[0].windSpeed != null)
-            wind_mph = Math.round(getFirstMatch(/^([0-9]+)/, json.properties.periods[0].windSpeed));    // number at beginning of line
+    try{
+        var period = currentPeriod(json);
+        if (period.windSpeed != null)
+            wind_mph = parseFloat(getFirstMatch(/^([0-9]+)/, period.windSpeed));    // number at beginning of line
 
-        if (json.properties.periods[0].windDirection != null)
-            wind_dir = formatNOAAWindString(json.properties.periods[0].windDirection);
+        if (period.windDirection != null)
+            wind_dir = compassToDegrees(period.windDirection);
     }
     catch(err){        
         wind_mph = DEFAULT_VALUE;
         wind_dir = DEFAULT_VALUE;
     }
     
-    dictionary[KEY_WIND] = wind_mph + ' ' + wind_dir;
+    dictionary.wind_dkt = wind_mph * DECIKNOTS_PER_MPH;
+    dictionary.wind_deg = wind_dir;
+}
+
+// The offline forecast: every PACK_EVERY_MS, the next day of NOAA's hourly
+// forecast for here and each saved waypoint goes to the watch, one message
+// per point.  The watch shows it when the phone has a fix but no data.
+// For here these are the responses the refresh just cached.  The attempt
+// is what counts, so points NOAA doesn't cover, whose failures aren't
+// cached, aren't asked for again every refresh.
+function sendPacks(pos){
+    var sent = parseJSON(window.localStorage.getItem(PACK_SENT));
+    if (sent !== null && Date.now() - sent < PACK_EVERY_MS){
+        return;
+    }
+    window.localStorage.setItem(PACK_SENT, JSON.stringify(Date.now()));
+
+    var points = [{lat: pos.coords.latitude, lon: pos.coords.longitude}];
+    getFromStorage(WAYPOINTS, '', false).split(';').forEach(function(waypoint){
+        var lat = parseFloat(waypoint.split(',')[0]);
+        var lon = parseFloat(waypoint.split(',')[1]);
+        if (isFinite(lat) && isFinite(lon) && points.length < PACK_POINTS){
+            points.push({lat: lat, lon: lon});
+        }
+    });
+    points.forEach(sendPackPoint);
+}
+
+function sendPackPoint(point, index){
+    var pos = {coords: {latitude: point.lat, longitude: point.lon}};
+    var url = 'https://api.weather.gov/points/' + point.lat + ',' + point.lon;
+
+    cachedGet(url, 'point:' + coordKey(pos), POINT_TTL_MS,
+        function(json) {
+            var hourly = null;
+            try{
+                hourly = json.properties.forecastHourly;
+            }
+            catch(err){
+                hourly = null;
+            }
+            if (!hourly){
+                return;
+            }
+
+            cachedGet(hourly, 'hourly:' + hourly, HOURLY_TTL_MS,
+                function(json) {
+                    var pack = hourlyPack(json, point, index);
+                    if (pack === null){
+                        return;
+                    }
+                    // a full queue isn't NOAA's doing; try the next refresh
+                    if (!sendPack(pack)){
+                        window.localStorage.removeItem(PACK_SENT);
+                    }
+                },
+                function() {});
+        },
+        function() {});
+}
+
+// The pack struct from an hourly forecast, starting with the hour now is in,
+// or null if it has none of the coming hours.
+function hourlyPack(json, point, index){
+    var limit = 0;
+    PACK_FIELDS.forEach(function(field){
+        if (field[0] == 'temp'){
+            limit = field[3];
+        }
+    });
+
+    var periods;
+    try{
+        periods = json.properties.periods;
+        periods.length.toFixed();
+    }
+    catch(err){
+        return null;
+    }
+
+    var now = Date.now();
+    var pack = {start: 0, point: index, count: 0,
+                lat_e5: Math.round(point.lat * LONGLAT_SCALE),
+                lon_e5: Math.round(point.lon * LONGLAT_SCALE),
+                wind_dkt: [], wind_deg: [], temp: [], forecast: []};
+
+    for (var i = 0; i < periods.length && pack.count < limit; i++){
+        var period = periods[i];
+        var start = new Date(period.startTime).getTime();
+        if (!isFinite(start) || new Date(period.endTime).getTime() <= now){
+            continue;
+        }
+        if (pack.count === 0){
+            pack.start = Math.floor(start / 3600000) * 3600;
+        }
+
+        var wind_mph = parseFloat(getFirstMatch(/^([0-9]+)/, period.windSpeed || ''));
+        var temp = period.temperature;
+        if (temp != null && units_celsius){
+            temp = FtoC(temp);
+        }
+
+        pack.wind_dkt.push(wind_mph * DECIKNOTS_PER_MPH);
+        pack.wind_deg.push(period.windDirection ? compassToDegrees(period.windDirection) : DEFAULT_VALUE);
+        pack.temp.push(temp == null ? DEFAULT_VALUE : Math.round(temp));
+        pack.forecast.push(period.icon ? forecastCode(noaaIconWeather(period.icon)) : DEFAULT_VALUE);
+        pack.count++;
+    }
+
+    return pack.count > 0 ? pack : null;
 }
 
-function callNOAAForTideStationId(pos)
+function callNOAAForTideStationId(pos, batch, callback)
 {    
-    var url = 'https://tidesandcurrents.noaa.gov/mdapi/latest/webapi/tidepredstations.json?lat=' + pos.coords.latitude + '&lon=' + pos.coords.longitude + '&radius=50';                   
-    
-    var xhReq = new XMLHttpRequest();
-    
-    xhReq.onload = function() {
-        
-        var stationId = "";
-        
-        try{            
-            var json = JSON.parse(this.responseText);
-        
-            for(var i = 0; i < json.stationList.length; i++){
-                if(json.stationList[i].stationType == 'R'){
-                    stationId = json.stationList[i].stationId;
-                    break;
-                }
-            }                                               
-        }catch(err){
-            // do nothing
-        }                
+    // stations are tens of km apart; don't look again for a short move
+    var cachedId = nearCache(TIDE_STATION, pos, STATION_MOVE_M);
+    if (cachedId !== null){
+        callNOAAForTide(cachedId, callback);
+        return;
+    }
 
-        callNOAAForTide(stationId);        
-    };
+    var url = 'https://tidesandcurrents.noaa.gov/mdapi/latest/webapi/tidepredstations.json?lat=' + pos.coords.latitude + '&lon=' + pos.coords.longitude + '&radius=50';                   
     
-    xhReq.open("GET", url);
-    xhReq.send();               
+    cachedGet(url, 'stations:' + coordKey(pos), STATION_TTL_MS,
+        function(json) {
+            var stationId = "";
+
+            try{            
+                for(var i = 0; i < json.stationList.length; i++){
+                    if(json.stationList[i].stationType == 'R'){
+                        stationId = json.stationList[i].stationId;
+                        break;
+                    }
+                }                                               
+            }catch(err){
+                // do nothing
+            }                
+
+            if (stationId !== ""){
+                nearRemember(TIDE_STATION, pos, stationId);
+            }
+            callNOAAForTide(stationId, callback);        
+        },
+        function() {
+            callback(null);
+        });
 }
 
-function callNOAAForTide(stationId)
+function callNOAAForTide(stationId, callback)
 {
-    var dateString = getNOAADateString(); 
+    var dateString = getNOAADateString(new Date(Date.now() - TIDE_BACK_MS)); 
     
-    var url = "https://tidesandcurrents.noaa.gov/api/datagetter?begin_date=" + dateString + "&range=7&station=" + stationId + "&product=predictions&datum=mllw&units=english&time_zone=lst_ldt&application=web_services&format=json";               
+    // just the highs and lows, in gmt so they convert straight to epoch time
+    var url = "https://tidesandcurrents.noaa.gov/api/datagetter?begin_date=" + dateString + "&range=" + TIDE_RANGE_HOURS + "&station=" + stationId + "&product=predictions&interval=hilo&datum=mllw&units=english&time_zone=gmt&application=web_services&format=json";               
     
-    var xhReq = new XMLHttpRequest();
-    
-    xhReq.onload = function() {
-        
-        var dictionary = {}; 
-
-        var json = null;
-        try{
-            json = JSON.parse(this.responseText);        
-        } catch(err){
-        }
-                
-        getNOAATide(json, dictionary);
-                                
-        // send populated data
-        sendData(dictionary);
-    };
-    
-    xhReq.open("GET", url);
-    xhReq.send();               
+    cachedGet(url, 'tide:' + stationId, TIDE_TTL_MS,
+        function(json) {
+            var dictionary = {}; 
+            getNOAATide(json, dictionary);
+            callback(dictionary);
+        },
+        function() {
+            callback(null);
+        });
 }
 
-function getNOAADateString(){
-    var date = new Date();
-    return makeTwoDigit(date.getMonth() + 1) + "/" + makeTwoDigit(date.getDate()) + "/" + date.getFullYear() + "%20" + makeTwoDigit(date.getHours()) + ":" + makeTwoDigit(date.getMinutes()) + "";        
+// gmt, to match time_zone=gmt
+function getNOAADateString(date){
+    return makeTwoDigit(date.getUTCMonth() + 1) + "/" + makeTwoDigit(date.getUTCDate()) + "/" + date.getUTCFullYear() + "%20" + makeTwoDigit(date.getUTCHours()) + ":" + makeTwoDigit(date.getUTCMinutes()) + "";        
 }
 
 function makeTwoDigit(datePart){
@@ -677,52 +1681,24 @@ function makeTwoDigit(datePart){
 
 function getNOAATide(json, dictionary) {
 
-	var tide_height = DEFAULT_VALUE;
-	var next_tide_height = DEFAULT_VALUE;
-	var next_tide_time = DEFAULT_VALUE;
-	var station_name = DEFAULT_VALUE + ", " + DEFAULT_VALUE;
-	
-	try {
-        var currentPrediction = parseFloat(json.predictions[0].v);
-        var nextPrediction = parseFloat(json.predictions[1].v);
-        var goingUp = currentPrediction < nextPrediction;
-                
-        var index;
-        for (index = 1; index < json.predictions.length; index++) {
-            var trail = parseFloat(json.predictions[index - 1].v);
-            var trav = parseFloat(json.predictions[index].v);
-            var goingUpNow = trail < trav;
-            if (goingUpNow != goingUp) {
-                break;
-            }
-        }        
-        var next = json.predictions[index - 1];
+    var events = [];
 
-        tide_height = Math.round(currentPrediction);
-        next_tide_height = Math.round(parseFloat(next.v));
-        next_tide_time = timeStringToTwelveHour(next.t.split(" ")[1]);
-               
+    try {
+        for (var i = 0; i < json.predictions.length; i++) {
+            // "yyyy-mm-dd hh:mm" in gmt
+            var parts = json.predictions[i].t.split(/[- :]/);
+            events.push({time: Date.UTC(parseInt(parts[0], 10), parseInt(parts[1], 10) - 1,
+                                        parseInt(parts[2], 10), parseInt(parts[3], 10),
+                                        parseInt(parts[4], 10)),
+                         cm: parseFloat(json.predictions[i].v) * CM_PER_FOOT});
+        }
     } catch (err) {
-        tide_height = DEFAULT_VALUE;
-        next_tide_height = DEFAULT_VALUE;
-        next_tide_time = DEFAULT_VALUE;
-        station_name = DEFAULT_VALUE + ", " + DEFAULT_VALUE;
+        events = [];
     }
-    
-    dictionary[KEY_TIDE] = tide_height + '/' + next_tide_height + '  ' + next_tide_time;
-}
-
-function timeStringToTwelveHour(timeString){    
-    var hours = timeString.split(":")[0];
-    var minutes = timeString.split(":")[1];    
-    return toTwelveHour(hours) + ":" + minutes;
-}
 
-function toTwelveHour(hour){
-    var result = (hour - 1) % 12 + 1;
-    if (result == 0) result += 12;   // 12am is zero
-    
-    return result
+    if (events.length > 0) {
+        dictionary.tides = tideTable(events);
+    }
 }
 
 function FtoC(temp){
@@ -742,21 +1718,27 @@ function getFirstMatch(regex, string) {
     return result;
 }
 
-function degToCompass(num) {
-    var val = Math.floor((num / 22.5) + 0.5);
-    var arr = ["North", "NNE", "NE", "ENE", "East", "ESE", "SE", "SSE", "South", "SSW", "SW", "WSW", "West", "WNW", "NW", "NNW"];
-    return arr[(val % 16)];
+// bearing in degrees for a compass point like 'SW' or 'North'; the watch
+// turns it back into text
+function compassToDegrees(wind_direction){
+    var points = ["n", "nne", "ne", "ene", "e", "ese", "se", "sse", "s", "ssw", "sw", "wsw", "w", "wnw", "nw", "nnw"];
+    var names = {north: "n", east: "e", south: "s", west: "w"};
+    var wind_lower = wind_direction.toLowerCase();
+    var index = points.indexOf(names[wind_lower] || wind_lower);
+
+    return index < 0 ? DEFAULT_VALUE : index * 22.5;
 }
 
-function formatNOAAWindString(wind_direction){
-    var wind_lower = wind_direction.toLowerCase();
-    switch(wind_lower){
-        case 'n': return "north"; break;
-        case 'e': return "east"; break;
-        case 's': return "south"; break;
-        case 'w': return "west"; break;
-        default: return wind_lower;
+// forecast words like 'rain?' become a FORECAST index, flagged when it's
+// only a chance
+function forecastCode(weather){
+    var chance = weather.charAt(weather.length - 1) == '?';
+    var index = FORECAST.indexOf(chance ? weather.slice(0, -1) : weather);
+
+    if (index < 0){
+        return DEFAULT_VALUE;
     }
+    return index | (chance ? FORECAST_CHANCE : 0);
 }
 
 function wundergroundWeatherString(raw_weather){
@@ -1,143 +1,937 @@
 #include <pebble.h>
+#include "shared.h"
+#include "glyphs.auto.h"
+#include "platform.auto.h"
 
-#define KEY_TIDE                0
-#define KEY_WIND                1
-#define KEY_SUNSET              2
-#define KEY_TEMP                3
-#define KEY_LOCATION            6
-#define KEY_INVERT              8
 #define KEY_SETTINGS            11
-#define KEY_FORECAST            13
+#define KEY_STATS_CACHE         14
+#define KEY_WORKER_LAUNCHED     15      // when the face first launched it
+#define KEY_PACK_CACHE          20      // to KEY_PACK_CACHE + PACK_POINTS - 1
+
+// the tide table covers a week; ask for a new one daily in case we've moved
+#define TIDES_REFETCH_S         (24 * 60 * 60)
+
+// the groups only a phone with a network can send; they alone keep the
+// weather fresh
+#define PRESENT_LIVE            (PRESENT_WIND | PRESENT_TEMP | PRESENT_FORECAST)
+
+// the offline forecast: where the phone was plus its saved waypoints, one
+// persist key each.  It stands in for the weather once nothing has arrived
+// for longer than the scheduler ever waits, power stages included.  A
+// change to PackMessage needs a new PACK_VERSION.
+#define PACK_POINTS             4
+#define PACK_AFTER_S            ((REFRESH_NIGHT_MIN + REFRESH_DAY_MIN) * 60)
+#define PACK_VERSION            1
+
+// the counters are saved every STATS_SAVE_S and on exit, and go to the phone
+// with the next message once they cover STATS_SEND_S
+#define STATS_SAVE_S            (3 * 60 * 60)
+#define STATS_SEND_S            (6 * 60 * 60)
+
+// counters stick at their maximum rather than wrapping
+#define STATS_COUNT(field)      (s_stats.field += s_stats.field < UINT16_MAX)
 
 #define IMAGE_NUMBER            8
+#define IMAGE_SIZE              26      // frames sit side by side in the atlas
 #define IMAGE_DELAY             50
 #define IMAGE_LOOPS             10
 
-#define APP_MESSAGE_IN_SIZE     1000
-#define APP_MESSAGE_OUT_SIZE    1000
+#define DEFAULT_VALUE           "..."
+#define ROW_TEXT_SIZE           40
+
+// outbox retries back off from RETRY_MIN_MS, doubling up to RETRY_MAX_MS;
+// after RETRY_ATTEMPTS the refresh scheduler asks again
+#define RETRY_MIN_MS            500
+#define RETRY_MAX_MS            16000
+#define RETRY_ATTEMPTS          6
+
+// minutes between weather refreshes; the scheduler picks one from the data
+#define REFRESH_DAY_MIN         30
+#define REFRESH_NIGHT_MIN       120     // the longest wait; < STALE_AFTER_S
+#define REFRESH_SOON_MIN        20      // a tide turn, sunrise or sunset is near
+#define REFRESH_GUSTY_MIN       15      // wind moved a lot since last time
+#define REFRESH_EVENT_MIN       60      // how near counts as near
+#define REFRESH_GUSTY_DKT       50      // 5 knots between refreshes
+// a refresh with no answer, or one with nothing live, is retried after
+// REFRESH_RETRY_MIN, doubling up to REFRESH_RETRY_MAX_MIN or the normal
+// interval, whichever is longer
+#define REFRESH_RETRY_MIN       5
+#define REFRESH_RETRY_MAX_MIN   REFRESH_NIGHT_MIN
+
+// Power stages, POWER_* in messages.json, each giving up one more thing:
+// a shorter spin, no spin and refreshes twice as far apart, refreshes four
+// times as far apart and the tide and forecast rows only every
+// POWER_ROWS_MIN, then the time and date alone with nothing asked of the
+// phone.  Refreshes stretch no further than REFRESH_NIGHT_MIN, so a healthy
+// face never looks stale.  The battery percent each starts at comes with
+// the flags.
+#define POWER_SHORT_LOOPS       1
+#define POWER_ROWS_MIN          10
+// stepping back up waits until the battery is this far over the level that
+// stepped down, so a reading wobbling between two steps doesn't flap
+#define POWER_RISE_PCT          10
+#define POWER_PCT_DEFAULT       { 50, 30, 20, 10 }
+// the rows POWER_CLOCK_ONLY still draws
+#define CLOCK_ROWS              ((1 << ROW_TIME) | (1 << ROW_DAY) \
+                                 | (1 << ROW_TIME_TXT) | (1 << ROW_DAY_TXT))
+
+// what is waiting for the outbox; sent together in one message
+#define OUTBOX_REFRESH          (1 << 0)
+#define OUTBOX_ACK              (1 << 1)
+#define OUTBOX_STATS            (1 << 2)
 
 struct Config{
     bool invert_colors;
 };
 static struct Config settings;
 
+// one point of the offline forecast, stored under KEY_PACK_CACHE + point
+typedef struct PackCache {
+        uint8_t version;
+        PackMessage pack;
+} PackCache;
+
+// rows of the face, drawn in this order
+enum {
+        ROW_TIME,
+        ROW_TIDE,
+        ROW_WIND,
+        ROW_SUNSET,
+        ROW_TEMP,
+        ROW_DAY,
+        ROW_TIME_TXT,
+        ROW_TIDE_TXT,
+        ROW_WIND_TXT,
+        ROW_SUNSET_TXT,
+        ROW_TEMP_TXT,
+        ROW_DAY_TXT,
+        ROW_LOC_TXT,
+        ROW_COUNT
+};
+
+// one strip of the glyph atlas: a fixed width cell per character
+typedef struct GlyphStrip {
+        const char *chars;
+        int16_t y;                      // of the strip in the atlas
+        int16_t w;
+        int16_t h;
+        int16_t top;                    // of a cell, down from the row's y
+} GlyphStrip;
+
+// cells sit on the baseline the system font they replace had in the row
+static const GlyphStrip s_glyphs_time = { GLYPH_TIME_CHARS, GLYPH_TIME_Y,
+        GLYPH_TIME_W, GLYPH_TIME_H, 28 - GLYPH_TIME_BASELINE };
+static const GlyphStrip s_glyphs_day = { GLYPH_DAY_CHARS, GLYPH_DAY_Y,
+        GLYPH_DAY_W, GLYPH_DAY_H, 24 - GLYPH_DAY_BASELINE };
+
+// where and how each row is drawn; every row spans the window's width
+typedef struct RowLayout {
+        int16_t y;
+        int16_t h;
+        const char *font;               // for text the glyphs can't show
+        GTextAlignment alignment;
+        bool bar;                       // drawn over the location bar
+        const GlyphStrip *glyphs;       // NULL to always use the font
+} RowLayout;
+
+static const RowLayout s_layout[ROW_COUNT] = {
+        [ROW_TIDE]       = { -2,  25, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentRight, false },
+        [ROW_SUNSET]     = { 23,  25, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentRight, false },
+        [ROW_WIND]       = { 48,  25, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentRight, false },
+        [ROW_TIME]       = { 73,  40, FONT_KEY_GOTHIC_28_BOLD,
+                             GTextAlignmentRight, false, &s_glyphs_time },
+        [ROW_DAY]        = { 103, 26, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentRight, false, &s_glyphs_day },
+        [ROW_TEMP]       = { 128, 26, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentRight, false },
+        [ROW_TIDE_TXT]   = { -2,  25, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentLeft, false },
+        [ROW_SUNSET_TXT] = { 23,  25, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentLeft, false },
+        [ROW_WIND_TXT]   = { 48,  25, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentLeft, false },
+        [ROW_TIME_TXT]   = { 73,  40, FONT_KEY_GOTHIC_28_BOLD,
+                             GTextAlignmentLeft, false },
+        [ROW_DAY_TXT]    = { 103, 26, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentLeft, false },
+        [ROW_TEMP_TXT]   = { 128, 26, FONT_KEY_GOTHIC_24_BOLD,
+                             GTextAlignmentLeft, false },
+        [ROW_LOC_TXT]    = { 153, 15, FONT_KEY_GOTHIC_14,
+                             GTextAlignmentCenter, true },
+};
+
+// the location bar behind ROW_LOC_TXT, along the bottom
+#define BAR_H                   15
+#define BAR_Y                   (DISPLAY_H - BAR_H + 4)
+
 static Window *s_main_window;
-static TextLayer *s_time_layer;
-static TextLayer *s_tide_layer;
-static TextLayer *s_wind_layer;
-static TextLayer *s_sunset_layer;
-static TextLayer *s_temp_layer;
-static TextLayer *s_day_layer;
-static TextLayer *s_loc_layer;
-static TextLayer *s_time_txt_layer;
-static TextLayer *s_tide_txt_layer;
-static TextLayer *s_wind_txt_layer;
-static TextLayer *s_sunset_txt_layer;
-static TextLayer *s_temp_txt_layer;
-static TextLayer *s_day_txt_layer;
-static TextLayer *s_loc_txt_layer;
-
-static BitmapLayer *s_prop_layer;
-static GBitmap *s_prop_bitmap[IMAGE_NUMBER];
+static Layer *s_face_layer;
+static Layer *s_prop_layer;             // on s_face_layer, one frame big
+static char s_row_text[ROW_COUNT][ROW_TEXT_SIZE];
+static GFont s_row_font[ROW_COUNT];
+
+static GBitmap *s_glyph_atlas;
+static GBitmap *s_glyph_cell;           // moves across s_glyph_atlas
+static GBitmap *s_prop_rest;            // frame 0, kept between animations
+static GBitmap *s_prop_atlas;           // every frame, only while animating
+static GBitmap *s_prop_frame;           // moves across s_prop_atlas
 static int image_to_display;
+static AppTimer *s_prop_timer;
+static int64_t s_prop_start_ms;         // wall clock time of frame 0
 
 static bool invert_colors = false;
 static GColor backcolormain;
-static GColor backcolortext;
 static GColor textcolortext;
 static GColor backcolorbar;
 static GColor textcolorbar;
 
+// everything received so far, merged group by group
+static WeatherMessage s_weather;
+// when wind, temperature or a forecast last came, 0 until one has; the
+// flags, sun and position an offline phone still sends don't count
+static time_t s_live_fetched;
+static bool s_weather_stale;
+static TidesMessage s_tides;
+static time_t s_tides_fetched;
+
+static time_t s_next_refresh;           // 0 asks on the next tick
+static bool s_refresh_pending;          // asked, nothing back yet
+static int s_refresh_failures;
+static uint16_t s_wind_change_dkt;      // between the last two wind readings
+
+static PackMessage s_pack;              // the point nearest the last position
+static bool s_pack_valid;
+static int s_pack_point = -1;
+static struct {
+        bool stored;
+        int32_t lat_e5;
+        int32_t lon_e5;
+} s_pack_where[PACK_POINTS];
+static int s_pack_hour = -1;            // hour shown from it, -1 when none
+
+static const char *s_power_names[] = POWER_NAMES;
+static int s_power = POWER_FULL;
+static int s_power_battery = POWER_FULL;        // before quiet time
+static BatteryChargeState s_battery;
+
+static StatsMessage s_stats;            // stored under KEY_STATS_CACHE
+static time_t s_stats_saved;
+
+static uint8_t s_outbox;
+static uint8_t s_outbox_in_flight;
+static uint16_t s_ack_seq;
+static uint16_t s_ack_in_flight;
+static int32_t s_last_seq = -1;         // last applied, so resends are dropped
+static AppTimer *s_retry_timer;
+static uint32_t s_retry_ms = RETRY_MIN_MS;
+static int s_retry_attempts;
+
 int main(void);
 static void deinit();
 static void init();
 static void main_window_unload(Window *);
 static void main_window_load(Window *);
-static void create_text_layers(Window *);
-static void initialize_text_layers();
-static void format_text(TextLayer *, char*, GTextAlignment, GColor, GColor);
+static void create_face_layer(Window *);
+static void draw_face(Layer *, GContext *);
+static void draw_prop(Layer *, GContext *);
+static void set_compositing(GContext *);
+static bool draw_glyphs(GContext *, const RowLayout *, const char *);
+static void initialize_rows();
+static void set_row_text(int, const char *);
 static void tick_handler(struct tm *, TimeUnits);
 static void update_time();
+static void refresh_if_due();
+static int refresh_interval_min();
+static int minutes_until(uint16_t, uint16_t);
+static void worker_start();
+static void worker_message_handler(uint16_t, AppWorkerMessage *);
+static void worker_hand_over();
 static void inbox_received_callback(DictionaryIterator *, void *);
+static void merge_weather(const WeatherMessage *);
+static void update_weather_rows(uint16_t);
+static void update_location_row();
+static void update_tide_row();
+static void show_tide_row(int, int16_t);
+static bool tides_wanted();
+static void save_tides();
+static void restore_tides();
+static void update_staleness();
+static void show_staleness(bool);
+static void save_weather();
+static void restore_weather();
+static void save_pack(const PackMessage *);
+static void restore_packs();
+static void select_pack();
+static void update_from_pack();
+static void power_start();
+static void power_update();
+static int power_stage();
+static int power_level(int);
+static void battery_handler(BatteryChargeState);
+static void stats_begin();
+static void stats_heap();
+static void stats_tick();
+static void save_stats();
+static void restore_stats();
+static void format_number(char [], size_t, int32_t, bool);
+static void format_minutes(char [], size_t, uint16_t);
+static void format_coordinate(char [], size_t, int32_t);
+static int cm_to_feet(int16_t);
 static void inbox_dropped_callback(AppMessageResult, void *);
 static void outbox_failed_callback(DictionaryIterator *, 
                                    AppMessageResult, void *); 
 static void outbox_sent_callback(DictionaryIterator *, void *);
+static void outbox_queue(uint8_t);
+static void outbox_flush();
+static void outbox_retry();
+static void retry_timer_handler(void *);
 static void to_lower_case(char []);
 static void strip_leading_day_zero(char [], char []);
-static void format_all_text_layers();
-static void add_all_text_layers(Window *);
-static void create_bitmap(Window *);
-static void set_bitmap_layer(int);
+static void create_bitmap();
+static void show_prop_frame(int);
 static void timer_handler(void *);
 static void rotate_prop();
+static int64_t wall_clock_ms();
 static void set_colors();
 static void set_bitmap_colors();
+static void load_prop_atlas();
+static void unload_prop_atlas();
+static void tint_bitmap(GBitmap *);
 static void set_colors();
 static void do_invert_colors(bool);
 static void restore_settings();
 
 static void inbox_received_callback(DictionaryIterator *iterator, void *context)
 {
-        static char tide_buffer[32];
-        static char wind_buffer[32];
-        static char sunset_buffer[32];
-        static char temp_buffer[32];
-        static char forecast_buffer[32];
-        static char loc_buffer[48];
-        static char invert_buffer[6];
+        WeatherMessage weather;
+        Tuple *weather_tuple = dict_find(iterator, KEY_WEATHER);
+        Tuple *tides_tuple = dict_find(iterator, KEY_TIDES);
+        Tuple *seq_tuple = dict_find(iterator, KEY_SEQ);
+        Tuple *pack_tuple = dict_find(iterator, KEY_PACK);
+
+        STATS_COUNT(msgs_in);
+        stats_heap();
+
+        // ack everything, even a resend we've already applied, so the
+        // phone stops retrying it
+        if ( seq_tuple )
+        {
+                uint16_t seq = (uint16_t)seq_tuple->value->int32;
+
+                s_ack_seq = seq;
+                outbox_queue(OUTBOX_ACK);
+
+                if ( seq == s_last_seq )
+                {
+                        APP_LOG(APP_LOG_LEVEL_INFO, "Duplicate message %d", seq);
+                        return;
+                }
+                s_last_seq = seq;
+        }
+
+        if ( tides_tuple && tides_tuple->length == sizeof(s_tides) )
+        {
+                memcpy(&s_tides, tides_tuple->value->data, sizeof(s_tides));
+                if ( s_tides.count > ARRAY_LENGTH(s_tides.offset_min) )
+                        s_tides.count = ARRAY_LENGTH(s_tides.offset_min);
+                s_tides_fetched = time(NULL);
+                save_tides();
+                update_tide_row();
+        }
+
+        // a pack comes on its own and isn't an answer to a refresh
+        if ( pack_tuple && pack_tuple->length == sizeof(PackMessage) )
+        {
+                save_pack((const PackMessage *)pack_tuple->value->data);
+                select_pack();
+                return;
+        }
+
+        if ( !weather_tuple || weather_tuple->length != sizeof(weather) )
+        {
+                APP_LOG(APP_LOG_LEVEL_ERROR, "Unexpected message!");
+                return;
+        }
+
+        memcpy(&weather, weather_tuple->value->data, sizeof(weather));
+        if ( weather.present & s_weather.present & PRESENT_WIND )
+                s_wind_change_dkt = weather.wind_dkt > s_weather.wind_dkt ?
+                        weather.wind_dkt - s_weather.wind_dkt :
+                        s_weather.wind_dkt - weather.wind_dkt;
+        merge_weather(&weather);
+        if ( weather.present & PRESENT_LIVE )
+        {
+                s_live_fetched = time(NULL);
+                if ( s_pack_hour >= 0 )
+                {
+                        s_pack_hour = -1;
+                        update_location_row();
+                }
+        }
+        save_weather();
+        update_weather_rows(weather.present);
+        update_staleness();
+        if ( weather.present & PRESENT_COORDS )
+                select_pack();
+
+        // Weather, asked for or not, restarts the schedule.  A reply with
+        // nothing live leaves the ask pending, so the retries back off.
+        if ( weather.present & PRESENT_LIVE )
+        {
+                s_refresh_pending = false;
+                s_refresh_failures = 0;
+                s_next_refresh = s_live_fetched + refresh_interval_min() * 60;
+        }
+
+        if ( weather.present & PRESENT_FLAGS )
+                do_invert_colors( s_weather.flags & FLAG_INVERT );
+}
+
+static void merge_weather(const WeatherMessage *weather)
+{
+        uint16_t present = weather->present;
+
+        if ( present & PRESENT_FLAGS )
+        {
+                s_weather.flags = weather->flags;
+                memcpy(s_weather.power_pct, weather->power_pct,
+                       sizeof(s_weather.power_pct));
+        }
+        if ( present & PRESENT_SUN )
+        {
+                s_weather.sunrise_min = weather->sunrise_min;
+                s_weather.sunset_min = weather->sunset_min;
+        }
+        if ( present & PRESENT_WIND )
+        {
+                s_weather.wind_dkt = weather->wind_dkt;
+                s_weather.wind_deg = weather->wind_deg;
+        }
+        if ( present & PRESENT_TEMP )
+                s_weather.temp = weather->temp;
+        if ( present & PRESENT_TEMP_HILO )
+                s_weather.temp_hilo = weather->temp_hilo;
+        if ( present & PRESENT_FORECAST )
+                s_weather.forecast = weather->forecast;
+        if ( present & PRESENT_COORDS )
+        {
+                s_weather.lat_e5 = weather->lat_e5;
+                s_weather.lon_e5 = weather->lon_e5;
+                s_weather.present &= ~PRESENT_CITY;     // show the latest one
+        }
+        if ( present & PRESENT_CITY )
+        {
+                memcpy(s_weather.city, weather->city, sizeof(s_weather.city));
+                s_weather.city[sizeof(s_weather.city) - 1] = '\0';
+                s_weather.present &= ~PRESENT_COORDS;
+        }
+
+        s_weather.present |= present;
+}
+
+// format the groups in present from s_weather into their rows
+static void update_weather_rows(uint16_t present)
+{
+        static const char *forecast_names[] = FORECAST_NAMES;
+        static const char *compass[] = {
+                "north", "nne", "ne", "ene", "east", "ese", "se", "sse",
+                "south", "ssw", "sw", "wsw", "west", "wnw", "nw", "nnw"
+        };
+
+        char text[ROW_TEXT_SIZE];
+        char first[12];
+        char second[12];
+
+        if ( present & PRESENT_WIND )
+        {
+                // tenths of a knot back to the whole mph we've always shown
+                uint16_t dkt = s_weather.wind_dkt;
+                uint16_t deg = s_weather.wind_deg;
+                format_number(first, sizeof(first),
+                              ((int32_t)dkt * 1151 + 5000) / 10000,
+                              dkt != UNKNOWN_UINT16);
+                snprintf(text, sizeof(text), "%s %s", first,
+                         deg < 360 ? compass[((deg * 4 + 45) / 90) % 16]
+                                   : DEFAULT_VALUE);
+                set_row_text(ROW_WIND, text);
+        }
+        if ( present & PRESENT_SUN )
+        {
+                format_minutes(first, sizeof(first), s_weather.sunrise_min);
+                format_minutes(second, sizeof(second), s_weather.sunset_min);
+                snprintf(text, sizeof(text), "%s  %s",
+                         first, second);
+                set_row_text(ROW_SUNSET, text);
+        }
+        if ( present & (PRESENT_TEMP | PRESENT_TEMP_HILO) )
+        {
+                format_number(first, sizeof(first), s_weather.temp,
+                              (s_weather.present & PRESENT_TEMP)
+                              && s_weather.temp != UNKNOWN_INT8);
+                format_number(second, sizeof(second), s_weather.temp_hilo,
+                              (s_weather.present & PRESENT_TEMP_HILO)
+                              && s_weather.temp_hilo != UNKNOWN_INT8);
+                snprintf(text, sizeof(text), "%s/%s",
+                         first, second);
+                set_row_text(ROW_TEMP, text);
+        }
+        if ( present & PRESENT_FORECAST )
+        {
+                uint8_t code = s_weather.forecast & ~FORECAST_CHANCE;
+                if ( code < FORECAST_COUNT )
+                        snprintf(text, sizeof(text),
+                                 "%s%s", forecast_names[code],
+                                 s_weather.forecast & FORECAST_CHANCE ?
+                                 "?" : "");
+                else
+                        snprintf(text, sizeof(text),
+                                 "%s", DEFAULT_VALUE);
+                set_row_text(ROW_TEMP_TXT, text);
+        }
+        if ( present & (PRESENT_CITY | PRESENT_COORDS) )
+                update_location_row();
+}
+
+// the bar shows where the weather is for, or when it is from once stale
+static void update_location_row()
+{
+        char text[ROW_TEXT_SIZE];
+        char first[16];
+        char second[16];
+
+        if ( s_pack_hour >= 0 )
+                set_row_text(ROW_LOC_TXT, "forecast");
+        else if ( s_weather_stale )
+        {
+                struct tm *fetched = localtime(&s_live_fetched);
+                format_minutes(first, sizeof(first),
+                               fetched->tm_hour * 60 + fetched->tm_min);
+                snprintf(text, sizeof(text), "as of %s", first);
+                set_row_text(ROW_LOC_TXT, text);
+        }
+        else if ( s_weather.present & PRESENT_CITY )
+        {
+                snprintf(text, sizeof(text), "%s",
+                         s_weather.city);
+                set_row_text(ROW_LOC_TXT, text);
+        }
+        else if ( s_weather.present & PRESENT_COORDS )
+        {
+                format_coordinate(first, sizeof(first), s_weather.lat_e5);
+                format_coordinate(second, sizeof(second), s_weather.lon_e5);
+                snprintf(text, sizeof(text), "%s, %s",
+                         first, second);
+                set_row_text(ROW_LOC_TXT, text);
+        }
+        else
+                set_row_text(ROW_LOC_TXT, DEFAULT_VALUE);
+}
+
+// height now and the next high or low, from the tide table
+static void update_tide_row()
+{
+        time_t now = time(NULL);
+        int next = tide_next(&s_tides, now);
+
+        show_tide_row(next, next < 0 ? UNKNOWN_INT16
+                                     : tide_height_cm(&s_tides, next, now));
+}
+
+static void show_tide_row(int next, int16_t height_cm)
+{
+        char text[ROW_TEXT_SIZE];
+        char first[12];
+        char second[12];
+        char third[12];
 
-        Tuple *tide_tuple = dict_find(iterator, KEY_TIDE);
-        Tuple *wind_tuple = dict_find(iterator, KEY_WIND);
-        Tuple *sunset_tuple = dict_find(iterator, KEY_SUNSET);
-        Tuple *temp_tuple = dict_find(iterator, KEY_TEMP);
-        Tuple *forecast_tuple = dict_find(iterator, KEY_FORECAST);
-        Tuple *loc_tuple = dict_find(iterator, KEY_LOCATION);
-        Tuple *invert_tuple = dict_find(iterator, KEY_INVERT);
- 
-        if ( tide_tuple )
+        if ( next < 0 || next >= s_tides.count )
         {
-                snprintf(tide_buffer, sizeof(tide_buffer), "%s", 
-                        tide_tuple->value->cstring);
-                text_layer_set_text(s_tide_layer, tide_buffer);
+                set_row_text(ROW_TIDE, DEFAULT_VALUE);
+                return;
         }
-        if ( wind_tuple )
+
+        int16_t next_cm = s_tides.height_cm[next];
+        time_t when = tide_time(&s_tides, next);
+        struct tm *local = localtime(&when);
+
+        format_number(first, sizeof(first), cm_to_feet(height_cm),
+                      height_cm != UNKNOWN_INT16);
+        format_number(second, sizeof(second), cm_to_feet(next_cm),
+                      next_cm != UNKNOWN_INT16);
+        format_minutes(third, sizeof(third),
+                       local->tm_hour * 60 + local->tm_min);
+        snprintf(text, sizeof(text), "%s/%s  %s", first, second, third);
+        set_row_text(ROW_TIDE, text);
+}
+
+// whether the next refresh should bring a new tide table
+static bool tides_wanted()
+{
+        return s_tides.count == 0
+                || time(NULL) - s_tides_fetched > TIDES_REFETCH_S;
+}
+
+static void save_tides()
+{
+        TideCache cache;
+
+        cache.fetched = (uint32_t)s_tides_fetched;
+        cache.tides = s_tides;
+        persist_write_data(KEY_TIDE_CACHE, &cache, sizeof(cache));
+}
+
+static void restore_tides()
+{
+        TideCache cache;
+
+        if ( persist_read_data(KEY_TIDE_CACHE, &cache, sizeof(cache))
+             == (int)sizeof(cache)
+             && cache.tides.count <= ARRAY_LENGTH(cache.tides.offset_min) )
         {
-                snprintf(wind_buffer, sizeof(wind_buffer), "%s", 
-                        wind_tuple->value->cstring);
-                text_layer_set_text(s_wind_layer, wind_buffer);
+                s_tides = cache.tides;
+                s_tides_fetched = cache.fetched;
         }
-        if ( sunset_tuple )
+        update_tide_row();
+
+        // don't wait for the weather to come due
+        if ( tides_wanted() )
+                s_next_refresh = 0;
+}
+
+// flag the face once the weather on it is older than STALE_AFTER_S
+static void update_staleness()
+{
+        show_staleness(s_live_fetched != 0
+                       && time(NULL) - s_live_fetched > STALE_AFTER_S);
+}
+
+static void show_staleness(bool stale)
+{
+        if ( stale == s_weather_stale )
+                return;
+
+        s_weather_stale = stale;
+        APP_LOG(APP_LOG_LEVEL_INFO, "Weather %s", stale ? "stale" : "fresh");
+        update_location_row();
+}
+
+// one write per received message, so a restart shows what was last seen
+static void save_weather()
+{
+        WeatherCache cache;
+
+        cache.fetched = (uint32_t)s_live_fetched;
+        cache.weather = s_weather;
+        persist_write_data(KEY_WEATHER_CACHE, &cache, sizeof(cache));
+}
+
+static void restore_weather()
+{
+        WeatherCache cache;
+
+        // nothing stored yet, or stored by a build with another layout
+        if ( persist_read_data(KEY_WEATHER_CACHE, &cache, sizeof(cache))
+             != (int)sizeof(cache) )
+                return;
+
+        s_weather = cache.weather;
+        s_live_fetched = cache.fetched;
+        update_weather_rows(s_weather.present);
+        update_staleness();
+}
+
+// each point has its own key, so one write per pack message
+static void save_pack(const PackMessage *pack)
+{
+        PackCache cache;
+
+        if ( pack->point >= PACK_POINTS )
+                return;
+        cache.version = PACK_VERSION;
+        memcpy(&cache.pack, pack, sizeof(cache.pack));
+        persist_write_data(KEY_PACK_CACHE + pack->point, &cache,
+                           sizeof(cache));
+
+        s_pack_where[pack->point].stored = true;
+        s_pack_where[pack->point].lat_e5 = pack->lat_e5;
+        s_pack_where[pack->point].lon_e5 = pack->lon_e5;
+        if ( pack->point == s_pack_point )
+                s_pack_point = -1;      // reread it
+}
+
+// where each stored point is, so choosing one reads only that one
+static void restore_packs()
+{
+        PackCache cache;
+
+        for ( int i = 0; i < PACK_POINTS; i++ )
         {
-                snprintf(sunset_buffer, sizeof(sunset_buffer), "%s", 
-                        sunset_tuple->value->cstring);
-                text_layer_set_text(s_sunset_layer, sunset_buffer);
+                s_pack_where[i].stored =
+                        persist_read_data(KEY_PACK_CACHE + i, &cache,
+                                          sizeof(cache)) == (int)sizeof(cache)
+                        && cache.version == PACK_VERSION
+                        && cache.pack.count <= ARRAY_LENGTH(cache.pack.temp);
+                s_pack_where[i].lat_e5 = cache.pack.lat_e5;
+                s_pack_where[i].lon_e5 = cache.pack.lon_e5;
         }
-        if ( temp_tuple )
+        select_pack();
+}
+
+// Keep the stored point nearest the last position.  The phone still
+// gets a fix with no data, so this follows the boat from waypoint to
+// waypoint.  Degrees of longitude count less away from the equator.
+static void select_pack()
+{
+        PackCache cache;
+        int32_t lat = s_weather.lat_e5;
+        int32_t lon = s_weather.lon_e5;
+        bool located = (s_weather.present & PRESENT_COORDS)
+                       && lat != UNKNOWN_INT32 && lon != UNKNOWN_INT32;
+        int32_t scale = cos_lookup(TRIG_MAX_ANGLE * (lat / 100000) / 360);
+        int64_t best = INT64_MAX;
+        int nearest = -1;
+
+        for ( int i = 0; i < PACK_POINTS; i++ )
         {
-                snprintf(temp_buffer, sizeof(temp_buffer), "%s", 
-                        temp_tuple->value->cstring);
-                text_layer_set_text(s_temp_layer, temp_buffer);
+                if ( !s_pack_where[i].stored )
+                        continue;
+
+                // unlocated, the first stored point is here
+                int64_t distance = i;
+                if ( located )
+                {
+                        int64_t dy = ((int64_t)s_pack_where[i].lat_e5 - lat)
+                                     / 10;
+                        int64_t dx = ((int64_t)s_pack_where[i].lon_e5 - lon)
+                                     / 10 * scale / TRIG_MAX_RATIO;
+                        distance = dx * dx + dy * dy;
+                }
+                if ( distance < best )
+                {
+                        best = distance;
+                        nearest = i;
+                }
         }
-        if ( forecast_tuple )
+
+        if ( nearest == s_pack_point )
+                return;
+
+        s_pack_point = nearest;
+        s_pack_valid = nearest >= 0
+                && persist_read_data(KEY_PACK_CACHE + nearest, &cache,
+                                     sizeof(cache)) == (int)sizeof(cache);
+        if ( s_pack_valid )
+                s_pack = cache.pack;
+        s_pack_hour = -1;
+        update_from_pack();
+}
+
+// once the weather is PACK_AFTER_S old, show the pack's hour instead; only
+// a new hour changes the rows
+static void update_from_pack()
+{
+        time_t now = time(NULL);
+        int hour = s_pack_valid && now >= (time_t)s_pack.start
+                ? (now - (time_t)s_pack.start) / 3600 : -1;
+
+        if ( !s_pack_valid || s_live_fetched == 0
+             || now - s_live_fetched < PACK_AFTER_S
+             || hour < 0 || hour >= s_pack.count )
         {
-                snprintf(forecast_buffer, sizeof(forecast_buffer), "%s", 
-                        forecast_tuple->value->cstring);
-                text_layer_set_text(s_temp_txt_layer, forecast_buffer);
+                if ( s_pack_hour >= 0 )
+                {
+                        s_pack_hour = -1;
+                        update_location_row();
+                }
+                return;
         }
-        if ( loc_tuple )
+        if ( hour == s_pack_hour )
+                return;
+
+        APP_LOG(APP_LOG_LEVEL_INFO, "Forecast pack hour %d", hour);
+        s_pack_hour = hour;
+        s_weather.wind_dkt = s_pack.wind_dkt[hour];
+        s_weather.wind_deg = s_pack.wind_deg[hour];
+        s_weather.temp = s_pack.temp[hour];
+        s_weather.forecast = s_pack.forecast[hour];
+        s_weather.present |= PRESENT_WIND | PRESENT_TEMP | PRESENT_FORECAST;
+        update_weather_rows(PRESENT_WIND | PRESENT_TEMP | PRESENT_FORECAST);
+        update_location_row();
+}
+
+// known before the face first draws, so it doesn't spin on a flat battery
+static void power_start()
+{
+        s_battery = battery_state_service_peek();
+        s_power = power_stage();
+        battery_state_service_subscribe(battery_handler);
+        APP_LOG(APP_LOG_LEVEL_INFO, "Power %d%% starts %s",
+                s_battery.charge_percent, s_power_names[s_power]);
+}
+
+static void battery_handler(BatteryChargeState charge)
+{
+        s_battery = charge;
+        power_update();
+}
+
+// on each tick too, as quiet time comes and goes without an event
+static void power_update()
+{
+        int was = s_power;
+
+        s_power = power_stage();
+        if ( s_power == was )
+                return;
+
+        APP_LOG(APP_LOG_LEVEL_INFO, "Power %s -> %s at %d%%",
+                s_power_names[was], s_power_names[s_power],
+                s_battery.charge_percent);
+        STATS_COUNT(power_changes);
+
+        // the next refresh moves with the interval, out or back in
+        if ( !s_refresh_pending && s_live_fetched != 0 )
+                s_next_refresh = s_live_fetched
+                                 + refresh_interval_min() * 60;
+
+        // rows skipped on the way down are caught up on the way back
+        if ( s_power < was && s_power < POWER_SLOW_ROWS )
         {
-                snprintf(loc_buffer, sizeof(loc_buffer), "%s", 
-                        loc_tuple->value->cstring);
-                text_layer_set_text(s_loc_txt_layer, loc_buffer);
+                update_tide_row();
+                update_from_pack();
         }
+        if ( s_power == POWER_CLOCK_ONLY || was == POWER_CLOCK_ONLY )
+                layer_mark_dirty(s_face_layer);
+}
 
-        if ( invert_tuple )
+// Plugged in is always full.  Quiet time takes one more stage, short of
+// dropping the weather, since nobody is watching the spin.
+static int power_stage()
+{
+        int stage = POWER_FULL;
+
+        for ( int i = 1; i < POWER_COUNT && !s_battery.is_plugged; i++ )
         {
-                snprintf(invert_buffer, sizeof(invert_buffer), "%s",
-                        invert_tuple->value->cstring);
-                do_invert_colors( strcmp(invert_buffer,"true") == 0 );
+                int level = power_level(i);
+                int percent = s_battery.charge_percent;
+
+                if ( level > 0 && (percent <= level || (s_power_battery >= i
+                                   && percent < level + POWER_RISE_PCT)) )
+                        stage = i;
         }
+        s_power_battery = stage;
+
+        if ( quiet_time_is_active() && stage < POWER_SLOW_ROWS )
+                stage++;
+        return stage;
+}
+
+// the percent stage starts at, from the phone once it has said
+static int power_level(int stage)
+{
+        static const uint8_t defaults[POWER_COUNT - 1] = POWER_PCT_DEFAULT;
+
+        if ( s_weather.present & PRESENT_FLAGS )
+                return s_weather.power_pct[stage - 1];
+        return defaults[stage - 1];
+}
+
+// counters start from zero, heap from what is free now
+static void stats_begin()
+{
+        memset(&s_stats, 0, sizeof(s_stats));
+        s_stats.start = (uint32_t)time(NULL);
+        s_stats.heap_free_min = (uint32_t)heap_bytes_free();
+}
+
+// HEAP_BUDGET is what platforms.json allows this platform; the build
+// checks the buffers and bitmaps against it, this catches the rest
+static void stats_heap()
+{
+        uint32_t free = (uint32_t)heap_bytes_free();
+
+        if ( free < s_stats.heap_free_min )
+        {
+                if ( heap_bytes_used() > HEAP_BUDGET )
+                        APP_LOG(APP_LOG_LEVEL_WARNING, "Heap %d over budget",
+                                (int)heap_bytes_used());
+                s_stats.heap_free_min = free;
+        }
+}
+
+// save now and then; send with the next message once there's enough
+static void stats_tick()
+{
+        time_t now = time(NULL);
+
+        s_stats.battery_pct = s_battery.charge_percent;
+        s_stats.power = s_power;
+        STATS_COUNT(power_min[s_power]);
+
+        if ( now - s_stats_saved >= STATS_SAVE_S )
+                save_stats();
+        if ( now - (time_t)s_stats.start >= STATS_SEND_S )
+                s_outbox |= OUTBOX_STATS;
+}
+
+static void save_stats()
+{
+        persist_write_data(KEY_STATS_CACHE, &s_stats, sizeof(s_stats));
+        s_stats_saved = time(NULL);
+}
+
+static void restore_stats()
+{
+        if ( persist_read_data(KEY_STATS_CACHE, &s_stats, sizeof(s_stats))
+             != sizeof(s_stats) )
+                stats_begin();
+        s_stats_saved = time(NULL);
+}
+
+static void format_number(char buffer[], size_t size, int32_t value,
+                          bool known)
+{
+        if ( known )
+                snprintf(buffer, size, "%ld", (long)value);
+        else
+                snprintf(buffer, size, "%s", DEFAULT_VALUE);
+}
+
+// minutes since midnight as 12 hour h:mm
+static void format_minutes(char buffer[], size_t size, uint16_t minutes)
+{
+        if ( minutes >= 24 * 60 )
+        {
+                snprintf(buffer, size, "%s", DEFAULT_VALUE);
+                return;
+        }
+
+        int hour = (minutes / 60 + 11) % 12 + 1;
+        snprintf(buffer, size, "%d:%02d", hour, minutes % 60);
+}
+
+// degrees times 100000 as a five decimal string
+static void format_coordinate(char buffer[], size_t size, int32_t value)
+{
+        if ( value == UNKNOWN_INT32 )
+        {
+                snprintf(buffer, size, "%s", DEFAULT_VALUE);
+                return;
+        }
+
+        uint32_t magnitude = value < 0 ? -value : value;
+        snprintf(buffer, size, "%s%lu.%05lu", value < 0 ? "-" : "",
+                 (unsigned long)(magnitude / 100000),
+                 (unsigned long)(magnitude % 100000));
+}
+
+static int cm_to_feet(int16_t cm)
+{
+        int32_t hundredths = cm * 100;
+        return (hundredths + (hundredths < 0 ? -1524 : 1524)) / 3048;
 }
 
 static void do_invert_colors(bool invert){
@@ -155,63 +949,150 @@ static void do_invert_colors(bool invert){
         set_colors();
 
         window_set_background_color(s_main_window, backcolormain);
-        format_all_text_layers();
-
         set_bitmap_colors();
-        set_bitmap_layer(image_to_display);
+        layer_mark_dirty(s_face_layer);
 }
 
 static void inbox_dropped_callback(AppMessageResult reason, void *context) 
 {
+        // the phone hears about this and resends
         APP_LOG(APP_LOG_LEVEL_ERROR, "Message dropped!");
+        STATS_COUNT(msgs_dropped);
 }
 
 static void outbox_failed_callback(DictionaryIterator *iterator, 
                                    AppMessageResult reason, void *context)
 {
         APP_LOG(APP_LOG_LEVEL_ERROR, "Outbox send failed!");
+        STATS_COUNT(sends_failed);
+        outbox_retry();
 }
 
 static void outbox_sent_callback(DictionaryIterator *iterator, void *context)
 {
         APP_LOG(APP_LOG_LEVEL_INFO, "Outbox send success!");
+
+        s_outbox &= ~(s_outbox_in_flight & OUTBOX_REFRESH);
+
+        // anything counted while they were in flight goes with them
+        if ( s_outbox_in_flight & OUTBOX_STATS )
+        {
+                s_outbox &= ~OUTBOX_STATS;
+                stats_begin();
+                save_stats();
+        }
+
+        // a newer seq may have arrived while the old ack was in flight
+        if ( (s_outbox_in_flight & OUTBOX_ACK) && s_ack_seq == s_ack_in_flight )
+                s_outbox &= ~OUTBOX_ACK;
+
+        s_outbox_in_flight = 0;
+        s_retry_attempts = 0;
+        s_retry_ms = RETRY_MIN_MS;
+        outbox_flush();
+}
+
+// queue a refresh request or ack and send it when the outbox is free
+static void outbox_queue(uint8_t what)
+{
+        s_outbox |= what;
+        outbox_flush();
+}
+
+static void outbox_flush()
+{
+        DictionaryIterator *iter;
+
+        if ( !s_outbox || s_outbox_in_flight || s_retry_timer )
+                return;
+
+        if ( app_message_outbox_begin(&iter) != APP_MSG_OK )
+        {
+                outbox_retry();
+                return;
+        }
+
+        if ( s_outbox & OUTBOX_REFRESH )
+                dict_write_uint8(iter, KEY_REFRESH,
+                                 tides_wanted() ? REFRESH_TIDES : 0);
+        if ( s_outbox & OUTBOX_ACK )
+                dict_write_uint16(iter, KEY_ACK, s_ack_seq);
+        if ( s_outbox & OUTBOX_STATS )
+                dict_write_data(iter, KEY_STATS, (const uint8_t *)&s_stats,
+                                sizeof(s_stats));
+
+        if ( app_message_outbox_send() != APP_MSG_OK )
+        {
+                outbox_retry();
+                return;
+        }
+
+        s_outbox_in_flight = s_outbox;
+        s_ack_in_flight = s_ack_seq;
+}
+
+static void outbox_retry()
+{
+        s_outbox_in_flight = 0;
+
+        if ( ++s_retry_attempts > RETRY_ATTEMPTS )
+        {
+                APP_LOG(APP_LOG_LEVEL_ERROR, "Giving up on outbox!");
+                s_outbox = 0;
+                s_retry_attempts = 0;
+                s_retry_ms = RETRY_MIN_MS;
+                return;
+        }
+
+        s_retry_timer = app_timer_register(s_retry_ms, retry_timer_handler,
+                                           NULL);
+        s_retry_ms = s_retry_ms * 2 < RETRY_MAX_MS ? s_retry_ms * 2
+                                                    : RETRY_MAX_MS;
+}
+
+static void retry_timer_handler(void *context)
+{
+        s_retry_timer = NULL;
+        outbox_flush();
 }
      
 static void update_time() {
+        update_staleness();
+
         // Get a tm structure
         time_t temp = time(NULL); 
         struct tm *tick_time = localtime(&temp);
-        static char s_final[13];
-        static char s_date_buffer[32];
-        static char s_final_date[32];
+        char final_time[13];
+        char date_buffer[32];
+        char final_date[32];
 
         // Write the current hours and minutes into a buffer
-        static char s_buffer[8];
-        strftime(s_buffer, sizeof(s_buffer), clock_is_24h_style() ?
+        char time_buffer[8];
+        strftime(time_buffer, sizeof(time_buffer), clock_is_24h_style() ?
                                           "%H:%M" : "%I:%M", tick_time);
 
         // get date
-        strftime(s_date_buffer, sizeof(s_date_buffer), 
+        strftime(date_buffer, sizeof(date_buffer), 
                                           "%m/%d  %a", tick_time);
 
         // Trim leading 0
-        s_final[0] = '\0';
-        if ( !clock_is_24h_style() && s_buffer[0] == '0' ) 
-                strcat(s_final, s_buffer + 1);
+        final_time[0] = '\0';
+        if ( !clock_is_24h_style() && time_buffer[0] == '0' ) 
+                strcat(final_time, time_buffer + 1);
         else
-                strcat(s_final, s_buffer);
+                strcat(final_time, time_buffer);
 
         // Trim leading date 0
-        strip_leading_day_zero(s_date_buffer, s_final_date);
+        strip_leading_day_zero(date_buffer, final_date);
 
         // Lowercase day value
-        to_lower_case(s_final_date);
+        to_lower_case(final_date);
 
         // Display this time on the TextLayer
-        text_layer_set_text(s_time_layer, s_final);
+        set_row_text(ROW_TIME, final_time);
 
         // Display date on the date layer
-        text_layer_set_text(s_day_layer, s_final_date);
+        set_row_text(ROW_DAY, final_date);
 }
 
 static void strip_leading_day_zero(char datestr[], char result[])
@@ -248,49 +1129,208 @@ static void to_lower_case(char str[])
 
 static void tick_handler(struct tm *tick_time, TimeUnits units_changed) {
 
-        // Get weather update every 30 minutes
-        if(tick_time->tm_min % 30 == 0) {
+        // the old values stay up until the new ones arrive
+        update_time();
+        power_update();
+        if ( s_power < POWER_SLOW_ROWS
+             || (s_power == POWER_SLOW_ROWS
+                 && tick_time->tm_min % POWER_ROWS_MIN == 0) )
+        {
+                update_tide_row();
+                update_from_pack();
+        }
+        refresh_if_due();
+        stats_tick();
+}
+
+// ask the phone for weather when the scheduler says so
+static void refresh_if_due()
+{
+        time_t now = time(NULL);
+
+        if ( now < s_next_refresh || s_power == POWER_CLOCK_ONLY )
+                return;
+
+        // the last ask got nothing live; try again, backing off, and without
+        // the spin, which is for the first ask only
+        bool retry_ask = s_refresh_pending;
+        if ( retry_ask )
+                s_refresh_failures++;
 
-                // clear the ui before getting weather; no stale data
-                initialize_text_layers();
-                update_time();
+        int retry = REFRESH_RETRY_MIN << (s_refresh_failures < 8 ?
+                                          s_refresh_failures : 8);
+        int interval = refresh_interval_min();
+        int most = interval > REFRESH_RETRY_MAX_MIN ? interval
+                                                    : REFRESH_RETRY_MAX_MIN;
 
-                // start the prop animation
+        s_refresh_pending = true;
+        s_next_refresh = now + (retry < most ? retry : most) * 60;
+        STATS_COUNT(refreshes);
+
+        // start the prop animation
+        if ( !retry_ask )
                 rotate_prop();
 
-                // Begin dictionary
-                DictionaryIterator *iter;
-                app_message_outbox_begin(&iter);
+        // retried if the radio is busy
+        outbox_queue(OUTBOX_REFRESH);
+}
 
-                // Add a key-value pair
-                dict_write_uint8(iter, 0, 0);
+// minutes until the next refresh, from what the weather is doing
+static int refresh_interval_min()
+{
+        time_t now = time(NULL);
+        struct tm *local = localtime(&now);
+        uint16_t minute = local->tm_hour * 60 + local->tm_min;
+        int interval = REFRESH_DAY_MIN;
 
-                // Send the message!
-                app_message_outbox_send();
+        if ( s_weather.present & PRESENT_SUN )
+        {
+                int sunrise = minutes_until(minute, s_weather.sunrise_min);
+                int sunset = minutes_until(minute, s_weather.sunset_min);
+
+                // sunset comes before sunrise only while the sun is up
+                if ( sunrise < sunset )
+                        interval = REFRESH_NIGHT_MIN;
+                if ( sunrise <= REFRESH_EVENT_MIN
+                     || sunset <= REFRESH_EVENT_MIN )
+                        interval = REFRESH_SOON_MIN;
         }
-        else {
-                // just get the time; don't clear ui
-                update_time();
+        else if ( local->tm_hour < 6 || local->tm_hour >= 21 )
+                interval = REFRESH_NIGHT_MIN;
+
+        if ( s_wind_change_dkt >= REFRESH_GUSTY_DKT
+             && interval > REFRESH_GUSTY_MIN )
+                interval = REFRESH_GUSTY_MIN;
+
+        int tide = tide_next(&s_tides, now);
+        if ( tide >= 0 && tide_time(&s_tides, tide) - now
+                          <= REFRESH_EVENT_MIN * 60
+             && interval > REFRESH_SOON_MIN )
+                interval = REFRESH_SOON_MIN;
+
+        if ( s_power >= POWER_SLOW_ROWS )
+                interval *= 4;
+        else if ( s_power >= POWER_SLOW_REFRESH )
+                interval *= 2;
+        if ( interval > REFRESH_NIGHT_MIN )
+                interval = REFRESH_NIGHT_MIN;
+
+        return interval;
+}
+
+// minutes from one minute of the day to the next time another comes round
+static int minutes_until(uint16_t from, uint16_t to)
+{
+        if ( to >= 24 * 60 )
+                return 24 * 60;
+        return (to - from + 24 * 60) % (24 * 60);
+}
+
+// The worker keeps the schedule while the face is closed, so opening it
+// again asks the phone only once a refresh is due, and has the tide and
+// staleness ready.  Without one the face works both out from its caches.
+//
+// There is only one worker slot, so it is launched the first time the face
+// runs and never again: if it isn't running later, the user has given the
+// slot to another app, and the face doesn't take it back.
+static void worker_start()
+{
+        AppWorkerMessage hello = { 0 };
+        uint32_t launched = (uint32_t)time(NULL);
+
+        app_worker_message_subscribe(worker_message_handler);
+        if ( !app_worker_is_running() && !persist_exists(KEY_WORKER_LAUNCHED) )
+        {
+                persist_write_data(KEY_WORKER_LAUNCHED, &launched,
+                                   sizeof(launched));
+                APP_LOG(APP_LOG_LEVEL_INFO, "Worker launch %d",
+                        app_worker_launch());
         }
+        app_worker_send_message(WORKER_HELLO, &hello);
+}
+
+static void worker_message_handler(uint16_t type, AppWorkerMessage *data)
+{
+        switch ( type )
+        {
+        case WORKER_SCHEDULE:
+                s_next_refresh = tides_wanted() ? 0
+                                 : time(NULL) + data->data0 * 60;
+                s_refresh_failures = data->data1;
+                s_wind_change_dkt = data->data2;
+                APP_LOG(APP_LOG_LEVEL_INFO, "Worker schedule in %d min",
+                        data->data0);
+                break;
+        case WORKER_SNAPSHOT:
+                show_tide_row(data->data1 == WORKER_NO_TIDE ? -1
+                              : data->data1, (int16_t)data->data0);
+                show_staleness(data->data2 & WORKER_STALE);
+                break;
+        }
+}
+
+// an ask still pending is dropped with the face, so it isn't a failure
+static void worker_hand_over()
+{
+        time_t now = time(NULL);
+        AppWorkerMessage schedule = {
+                .data0 = s_next_refresh > now ? (s_next_refresh - now + 59) / 60
+                                              : 0,
+                .data1 = s_refresh_failures,
+                .data2 = s_wind_change_dkt,
+        };
+
+        if ( app_worker_is_running() )
+                app_worker_send_message(WORKER_SCHEDULE, &schedule);
 }
 
 static void rotate_prop(){
 
-        // Schedule a timer to advance the first frame
-        app_timer_register(IMAGE_DELAY, timer_handler, NULL);
+        // already spinning, or saving the battery
+        if ( s_prop_timer || s_power >= POWER_SLOW_REFRESH )
+                return;
+
+        // the other frames are only decoded for the length of the spin
+        load_prop_atlas();
+
+        s_prop_start_ms = wall_clock_ms();
+        s_prop_timer = app_timer_register(IMAGE_DELAY, timer_handler, NULL);
 }
 
-static void timer_handler(void *context) {
+static int64_t wall_clock_ms(){
 
-        if(image_to_display < IMAGE_NUMBER * IMAGE_LOOPS){ 
-                image_to_display++;
-                set_bitmap_layer(image_to_display);
+        time_t seconds;
+        uint16_t ms = time_ms(&seconds, NULL);
+        return (int64_t)seconds * 1000 + ms;
+}
+
+// frame n is due IMAGE_DELAY * n after the start; a late timer skips to the
+// frame that is due now rather than stretching the spin
+static void timer_handler(void *context) {
 
-                // set next timer delay
-                app_timer_register(IMAGE_DELAY, timer_handler, NULL);
+        int64_t elapsed = wall_clock_ms() - s_prop_start_ms;
+        if ( elapsed < 0 )              // clock was set back
+                elapsed = 0;
+        int frame = elapsed / IMAGE_DELAY;
+        int loops = s_power >= POWER_SHORT_SPIN ? POWER_SHORT_LOOPS
+                                                : IMAGE_LOOPS;
+
+        if(frame < IMAGE_NUMBER * loops){ 
+                if ( frame != image_to_display )
+                {
+                        image_to_display = frame;
+                        show_prop_frame(image_to_display);
+                }
+
+                // wake for the next frame boundary
+                s_prop_timer = app_timer_register(
+                                (frame + 1) * IMAGE_DELAY - elapsed,
+                                timer_handler, NULL);
         } else {
+                s_prop_timer = NULL;
                 image_to_display = 0; 
-                set_bitmap_layer(image_to_display);
+                show_prop_frame(image_to_display);
+                unload_prop_atlas();
         }
 }
 
@@ -298,232 +1338,241 @@ static void set_colors(){
 
         if( !invert_colors ){
                 backcolormain = GColorBlack;
-                backcolortext = GColorClear;
                 textcolortext = GColorWhite;
                 backcolorbar = GColorWhite;
                 textcolorbar = GColorBlack;
         } else {
                 backcolormain = GColorWhite;
-                backcolortext = GColorClear;
                 textcolortext = GColorBlack;
                 backcolorbar = GColorBlack;
                 textcolorbar = GColorWhite;
         }
 }
 
-static void format_text(TextLayer *s_text_layer, char* font,
-                        GTextAlignment text_alignment, GColor backcolor, 
-                        GColor textcolor)
+static void set_row_text(int row, const char *text)
 {
+        if ( strncmp(s_row_text[row], text, ROW_TEXT_SIZE - 1) == 0 )
+                return;
 
-        // Improve the layout to be more like a watchface
-        text_layer_set_background_color(s_text_layer, backcolor);
-        text_layer_set_text_color(s_text_layer, textcolor);
-        text_layer_set_font(s_text_layer,
-        fonts_get_system_font(font));
-        text_layer_set_text_alignment(s_text_layer, text_alignment);
-
+        snprintf(s_row_text[row], ROW_TEXT_SIZE, "%s", text);
+        layer_mark_dirty(s_face_layer);
 }
 
-static void initialize_text_layers()
+static void initialize_rows()
 {
-        text_layer_set_text(s_time_layer, "...");
-        text_layer_set_text(s_tide_layer, ".../...  ...");
-        text_layer_set_text(s_wind_layer, "... ...");
-        text_layer_set_text(s_sunset_layer, "...  ...");
-        text_layer_set_text(s_temp_layer, ".../...");
-        text_layer_set_text(s_day_layer, ".../...  ..."); 
+        set_row_text(ROW_TIME, "...");
+        set_row_text(ROW_TIDE, ".../...  ...");
+        set_row_text(ROW_WIND, "... ...");
+        set_row_text(ROW_SUNSET, "...  ...");
+        set_row_text(ROW_TEMP, ".../...");
+        set_row_text(ROW_DAY, ".../...  ..."); 
         
-        text_layer_set_text(s_time_txt_layer, "now");
-        text_layer_set_text(s_tide_txt_layer, "tide");
-        text_layer_set_text(s_wind_txt_layer, "wind");
-        text_layer_set_text(s_sunset_txt_layer, "sun");
-        text_layer_set_text(s_temp_txt_layer, "...");
-        text_layer_set_text(s_day_txt_layer, "day");
-
-        text_layer_set_text(s_loc_layer, "");   // just background
-        text_layer_set_text(s_loc_txt_layer, "..., ...");
+        set_row_text(ROW_TIME_TXT, "now");
+        set_row_text(ROW_TIDE_TXT, "tide");
+        set_row_text(ROW_WIND_TXT, "wind");
+        set_row_text(ROW_SUNSET_TXT, "sun");
+        set_row_text(ROW_TEMP_TXT, "...");
+        set_row_text(ROW_DAY_TXT, "day");
+
+        set_row_text(ROW_LOC_TXT, "..., ...");
 }
 
-static void create_text_layers(Window *window)
+static void create_face_layer(Window *window)
 {
-        // Get information about the Window
         Layer *window_layer = window_get_root_layer(window);
-        GRect bounds = layer_get_bounds(window_layer);
-
-        s_tide_layer = text_layer_create(GRect(0, -2, bounds.size.w, 25));
-        s_sunset_layer = text_layer_create(GRect(0, 23, bounds.size.w, 25));
-        s_wind_layer = text_layer_create(GRect(0, 48, bounds.size.w, 25));
-        s_time_layer = text_layer_create(GRect(0, 73, bounds.size.w, 40));
-        s_day_layer = text_layer_create(GRect(0, 103, bounds.size.w, 26));
-        s_temp_layer = text_layer_create(GRect(0, 128, bounds.size.w, 26));
-        
-        s_tide_txt_layer = text_layer_create(GRect(0, -2, bounds.size.w, 25));
-        s_sunset_txt_layer = text_layer_create(GRect(0, 23, bounds.size.w, 25));
-        s_wind_txt_layer = text_layer_create(GRect(0, 48, bounds.size.w, 25));
-        s_time_txt_layer = text_layer_create(GRect(0, 73, bounds.size.w, 40));
-        s_day_txt_layer = text_layer_create(GRect(0, 103, bounds.size.w, 26));
-        s_temp_txt_layer = text_layer_create(GRect(0, 128, bounds.size.w, 26));
-
-
-        s_loc_layer = text_layer_create(GRect(0, 157, bounds.size.w, 15));
-        s_loc_txt_layer = text_layer_create(GRect(0, 153, bounds.size.w, 15));
-}
-
-static void format_all_text_layers()
-{
-
-        // format text layers
-        format_text(s_time_layer, FONT_KEY_GOTHIC_28_BOLD, GTextAlignmentRight,
-                    backcolortext, textcolortext);
-        format_text(s_tide_layer, FONT_KEY_GOTHIC_24_BOLD, GTextAlignmentRight,
-                    backcolortext, textcolortext);
-        format_text(s_wind_layer, FONT_KEY_GOTHIC_24_BOLD, GTextAlignmentRight,
-                    backcolortext, textcolortext);
-        format_text(s_sunset_layer,FONT_KEY_GOTHIC_24_BOLD,GTextAlignmentRight,
-                    backcolortext, textcolortext);
-        format_text(s_temp_layer, FONT_KEY_GOTHIC_24_BOLD, GTextAlignmentRight,
-                    backcolortext, textcolortext);
-        format_text(s_day_layer, FONT_KEY_GOTHIC_24_BOLD, GTextAlignmentRight,
-                    backcolortext, textcolortext);
-
-
-        // format text layers
-        format_text(s_time_txt_layer, FONT_KEY_GOTHIC_28_BOLD, 
-                    GTextAlignmentLeft, backcolortext, textcolortext);
-        format_text(s_tide_txt_layer, FONT_KEY_GOTHIC_24_BOLD, 
-                    GTextAlignmentLeft, backcolortext, textcolortext);
-        format_text(s_wind_txt_layer, FONT_KEY_GOTHIC_24_BOLD, 
-                    GTextAlignmentLeft, backcolortext, textcolortext);
-        format_text(s_sunset_txt_layer,FONT_KEY_GOTHIC_24_BOLD,
-                    GTextAlignmentLeft, backcolortext, textcolortext);
-        format_text(s_temp_txt_layer, FONT_KEY_GOTHIC_24_BOLD,
-                    GTextAlignmentLeft, backcolortext, textcolortext);
-        format_text(s_day_txt_layer, FONT_KEY_GOTHIC_24_BOLD, 
-                    GTextAlignmentLeft, backcolortext, textcolortext);
-        
 
-        format_text(s_loc_layer, FONT_KEY_GOTHIC_14, GTextAlignmentCenter,
-                    backcolorbar, backcolorbar);
-        format_text(s_loc_txt_layer, FONT_KEY_GOTHIC_14, GTextAlignmentCenter,
-                    backcolortext, textcolorbar);
+        for ( int i = 0; i < ROW_COUNT; i++ )
+                s_row_font[i] = fonts_get_system_font(s_layout[i].font);
 
-        layer_mark_dirty(text_layer_get_layer(s_time_layer));
-        layer_mark_dirty(text_layer_get_layer(s_tide_layer));
-        layer_mark_dirty(text_layer_get_layer(s_wind_layer));
-        layer_mark_dirty(text_layer_get_layer(s_sunset_layer));
-        layer_mark_dirty(text_layer_get_layer(s_temp_layer));
-        layer_mark_dirty(text_layer_get_layer(s_day_layer));
+        s_face_layer = layer_create(GRect(0, 0, DISPLAY_W, DISPLAY_H));
+        layer_set_update_proc(s_face_layer, draw_face);
+        layer_add_child(window_layer, s_face_layer);
 
-        layer_mark_dirty(text_layer_get_layer(s_time_txt_layer));
-        layer_mark_dirty(text_layer_get_layer(s_tide_txt_layer));
-        layer_mark_dirty(text_layer_get_layer(s_wind_txt_layer));
-        layer_mark_dirty(text_layer_get_layer(s_sunset_txt_layer));
-        layer_mark_dirty(text_layer_get_layer(s_temp_txt_layer));
-        layer_mark_dirty(text_layer_get_layer(s_day_txt_layer));
-
-        layer_mark_dirty(text_layer_get_layer(s_loc_layer));
-        layer_mark_dirty(text_layer_get_layer(s_loc_txt_layer));
+        s_prop_layer = layer_create(GRect((DISPLAY_W - IMAGE_SIZE) / 2,
+                                          (DISPLAY_H - IMAGE_SIZE) / 2,
+                                          IMAGE_SIZE, IMAGE_SIZE));
+        layer_set_update_proc(s_prop_layer, draw_prop);
+        layer_add_child(s_face_layer, s_prop_layer);
 }
 
-static void add_all_text_layers(Window *window)
+// the whole face but the propeller in one pass: location bar, then rows
+static void draw_face(Layer *layer, GContext *ctx)
 {
-        // Get information about the Window
-        Layer *window_layer = window_get_root_layer(window);
+        STATS_COUNT(redraws);
+        stats_heap();
 
-        // Add it as a child layer to the Window's root layer
-        layer_add_child(window_layer, text_layer_get_layer(s_time_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_tide_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_wind_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_sunset_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_temp_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_day_layer));
+        bool clock_only = s_power == POWER_CLOCK_ONLY;
 
-        // Add it as a child layer to the Window's root layer
-        layer_add_child(window_layer, text_layer_get_layer(s_time_txt_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_tide_txt_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_wind_txt_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_sunset_txt_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_temp_txt_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_day_txt_layer));
+        if ( !clock_only )
+        {
+                graphics_context_set_fill_color(ctx, backcolorbar);
+                graphics_fill_rect(ctx, GRect(0, BAR_Y, DISPLAY_W, BAR_H), 0,
+                                   GCornerNone);
+        }
 
-        layer_add_child(window_layer, text_layer_get_layer(s_loc_layer));
-        layer_add_child(window_layer, text_layer_get_layer(s_loc_txt_layer));
+        set_compositing(ctx);
+
+        for ( int i = 0; i < ROW_COUNT; i++ )
+        {
+                const RowLayout *row = &s_layout[i];
+                if ( clock_only && !(CLOCK_ROWS & (1 << i)) )
+                        continue;
+                if ( draw_glyphs(ctx, row, s_row_text[i]) )
+                        continue;
+
+                graphics_context_set_text_color(ctx, row->bar ? textcolorbar
+                                                              : textcolortext);
+                graphics_draw_text(ctx, s_row_text[i], s_row_font[i],
+                                   GRect(0, row->y, DISPLAY_W, row->h),
+                                   GTextOverflowModeWordWrap, row->alignment,
+                                   NULL);
+        }
 }
 
-static void create_bitmap(Window *window)
+static void draw_prop(Layer *layer, GContext *ctx)
 {
-        // Get information about the Window
-        Layer *window_layer = window_get_root_layer(window);
-        GRect bounds = layer_get_bounds(window_layer);
+        if ( s_power == POWER_CLOCK_ONLY )
+                return;
+
+        int frame = image_to_display % IMAGE_NUMBER;
+        GBitmap *bitmap = frame == 0 || !s_prop_frame ? s_prop_rest
+                                                      : s_prop_frame;
+        set_compositing(ctx);
+        graphics_draw_bitmap_in_rect(ctx, bitmap,
+                                     GRect(0, 0, IMAGE_SIZE, IMAGE_SIZE));
+}
+
+// how the white on transparent frames and glyphs go onto the face
+static void set_compositing(GContext *ctx)
+{
+#if defined(PBL_COLOR)
+        graphics_context_set_compositing_mode(ctx, GCompOpSet);
+#else
+        // clear draws the white pixels black
+        graphics_context_set_compositing_mode(ctx,
+                                    invert_colors ? GCompOpClear : GCompOpSet);
+#endif
+}
+
+// Blits text right aligned into the row's cells, one per character, a
+// space leaving its cell empty.  False, with nothing drawn, when the row has
+// no glyphs or the text has a character the atlas lacks.
+static bool draw_glyphs(GContext *ctx, const RowLayout *row, const char *text)
+{
+        const GlyphStrip *strip = row->glyphs;
+        int count = strlen(text);
+
+        if ( !strip || !s_glyph_cell )
+                return false;
+        for ( int i = 0; i < count; i++ )
+                if ( text[i] != ' ' && !strchr(strip->chars, text[i]) )
+                        return false;
+
+        int16_t x = DISPLAY_W - count * strip->w;
+        int16_t y = row->y + strip->top;
+        for ( int i = 0; i < count; i++, x += strip->w )
+        {
+                if ( text[i] == ' ' )
+                        continue;
+                int16_t cell = strchr(strip->chars, text[i]) - strip->chars;
+                gbitmap_set_bounds(s_glyph_cell, GRect(cell * strip->w,
+                                   strip->y, strip->w, strip->h));
+                graphics_draw_bitmap_in_rect(ctx, s_glyph_cell,
+                                   GRect(x, y, strip->w, strip->h));
+        }
+        return true;
+}
 
+static void create_bitmap()
+{
         // Create GBitmap
+        s_prop_rest = gbitmap_create_with_resource(RESOURCE_ID_IMAGE_PROP_REST);
+        s_glyph_atlas = gbitmap_create_with_resource(
+                                    RESOURCE_ID_IMAGE_GLYPH_ATLAS);
+        if ( s_glyph_atlas )
+                s_glyph_cell = gbitmap_create_as_sub_bitmap(s_glyph_atlas,
+                                    GRect(0, 0, 1, 1));
         set_bitmap_colors();
+}
+
+// the frames and glyphs are white on transparent; inverting recolours them in place
+// rather than loading a second set, and aplite composites them differently
+static void set_bitmap_colors(){
+
+#if defined(PBL_COLOR)
+        tint_bitmap(s_prop_rest);
+        tint_bitmap(s_prop_atlas);
+        tint_bitmap(s_glyph_atlas);
+#endif
+}
+
+// set every palette entry to the text colour, keeping its alpha
+static void tint_bitmap(GBitmap *bitmap){
 
-        // Create BitmapLayer to display the GBitmap
-        s_prop_layer = bitmap_layer_create(bounds);
+#if defined(PBL_COLOR)
+        int count;
 
-        // Set the bitmap onto the layer add to the window
-        set_bitmap_layer(0);
-        bitmap_layer_set_compositing_mode(s_prop_layer,GCompOpSet);
-        layer_add_child(window_layer, bitmap_layer_get_layer(s_prop_layer));
+        if ( !bitmap )
+                return;
 
+        switch ( gbitmap_get_format(bitmap) )
+        {
+        case GBitmapFormat1BitPalette:
+                count = 2;
+                break;
+        case GBitmapFormat2BitPalette:
+                count = 4;
+                break;
+        case GBitmapFormat4BitPalette:
+                count = 16;
+                break;
+        default:
+                return;
+        }
+
+        GColor *palette = gbitmap_get_palette(bitmap);
+        for ( int i = 0; i < count; i++ )
+                palette[i].argb = (palette[i].argb & 0xc0)
+                                  | (textcolortext.argb & 0x3f);
+#endif
 }
 
-static void set_bitmap_colors(){
+static void load_prop_atlas(){
+
+        if ( s_prop_atlas )
+                return;
+
+        s_prop_atlas = gbitmap_create_with_resource(
+                                    RESOURCE_ID_IMAGE_PROP_ATLAS);
+        tint_bitmap(s_prop_atlas);
+        if ( s_prop_atlas )
+                s_prop_frame = gbitmap_create_as_sub_bitmap(s_prop_atlas,
+                                    GRect(0, 0, IMAGE_SIZE, IMAGE_SIZE));
+}
+
+static void unload_prop_atlas(){
+
+        // the sub bitmap shares the atlas pixels, so it goes first
+        if ( s_prop_frame )
+                gbitmap_destroy(s_prop_frame);
+        if ( s_prop_atlas )
+                gbitmap_destroy(s_prop_atlas);
+        s_prop_frame = NULL;
+        s_prop_atlas = NULL;
+}
 
-        GBitmap *s_prop_bitmap_temp[IMAGE_NUMBER];
-
-       if ( !invert_colors ) {
-                s_prop_bitmap_temp[0] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP000);
-                s_prop_bitmap_temp[1] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP015);
-                s_prop_bitmap_temp[2] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP030);
-                s_prop_bitmap_temp[3] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP045);
-                s_prop_bitmap_temp[4] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP060);
-                s_prop_bitmap_temp[5] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP075);
-                s_prop_bitmap_temp[6] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP090);
-                s_prop_bitmap_temp[7] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP105);
-       } else {
-                s_prop_bitmap_temp[0] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP000_INVERT);
-                s_prop_bitmap_temp[1] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP015_INVERT);
-                s_prop_bitmap_temp[2] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP030_INVERT);
-                s_prop_bitmap_temp[3] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP045_INVERT);
-                s_prop_bitmap_temp[4] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP060_INVERT);
-                s_prop_bitmap_temp[5] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP075_INVERT);
-                s_prop_bitmap_temp[6] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP090_INVERT);
-                s_prop_bitmap_temp[7] = gbitmap_create_with_resource(
-                                            RESOURCE_ID_IMAGE_PROP105_INVERT);
-        }
-
-        for(int i = 0; i < IMAGE_NUMBER; i++){
-                GBitmap *s_prop_bitmap_old = s_prop_bitmap[i];
-                s_prop_bitmap[i] = s_prop_bitmap_temp[i];
-                if ( s_prop_bitmap_old )
-                    gbitmap_destroy(s_prop_bitmap_old);
-        }
-}
-
-static void set_bitmap_layer(int i_image_number){
+static void show_prop_frame(int i_image_number){
         
 	  	i_image_number = i_image_number % IMAGE_NUMBER;
-        bitmap_layer_set_bitmap(s_prop_layer, s_prop_bitmap[i_image_number]);
 
-        layer_mark_dirty(bitmap_layer_get_layer(s_prop_layer));
+        STATS_COUNT(prop_frames);
+
+        if ( i_image_number != 0 && s_prop_frame )
+                gbitmap_set_bounds(s_prop_frame,
+                                   GRect(i_image_number * IMAGE_SIZE, 0,
+                                         IMAGE_SIZE, IMAGE_SIZE));
+
+        layer_mark_dirty(s_prop_layer);
 }
 
 static void restore_settings(){
@@ -535,6 +1584,7 @@ static void restore_settings(){
 static void main_window_load(Window *window) {
     
         restore_settings();
+        restore_stats();
     
         // initialize colors
         set_colors();
@@ -542,18 +1592,24 @@ static void main_window_load(Window *window) {
         // set background color
         window_set_background_color(window, backcolormain);
 
-        // create text layers
-        create_text_layers(window);
-        initialize_text_layers();
+        // one layer draws every row; the propeller has a child layer of
+        // its own, so a new frame redraws just that
+        create_face_layer(window);
+        initialize_rows();
 
-        // format text layers
-        format_all_text_layers();
+        // show the last weather straight away; the phone refreshes it
+        restore_weather();
+        restore_tides();
+        restore_packs();
 
-        // add all text layers
-        add_all_text_layers(window);
+        // with the levels just restored, before the first spin and draw;
+        // then the schedule, which depends on all of them
+        power_start();
+        if ( s_live_fetched != 0 )
+                s_next_refresh = s_live_fetched + refresh_interval_min() * 60;
 
         // create the bitmap
-        create_bitmap(window);
+        create_bitmap();
 
         // start the prop animation
         rotate_prop();
@@ -561,29 +1617,21 @@ static void main_window_load(Window *window) {
 
 static void main_window_unload(Window *window) {
     
-        // Destroy TextLayer
-        text_layer_destroy(s_time_layer);
-        text_layer_destroy(s_tide_layer);
-        text_layer_destroy(s_wind_layer);
-        text_layer_destroy(s_sunset_layer);
-        text_layer_destroy(s_temp_layer);
-        text_layer_destroy(s_day_layer);        
-        
-        text_layer_destroy(s_time_txt_layer);
-        text_layer_destroy(s_tide_txt_layer);
-        text_layer_destroy(s_wind_txt_layer);
-        text_layer_destroy(s_sunset_txt_layer);
-        text_layer_destroy(s_temp_txt_layer);
-        text_layer_destroy(s_day_txt_layer);        
-
-        text_layer_destroy(s_loc_layer);        
-        text_layer_destroy(s_loc_txt_layer);        
+        layer_destroy(s_prop_layer);
+        layer_destroy(s_face_layer);
 
         // Destroy GBitmap
-        for(int i = 0; i < IMAGE_NUMBER; i++){
-                gbitmap_destroy(s_prop_bitmap[i]);
-        }
-        bitmap_layer_destroy(s_prop_layer);
+        if ( s_prop_timer )
+                app_timer_cancel(s_prop_timer);
+        s_prop_timer = NULL;
+        unload_prop_atlas();
+        gbitmap_destroy(s_prop_rest);
+        if ( s_glyph_cell )
+                gbitmap_destroy(s_glyph_cell);
+        if ( s_glyph_atlas )
+                gbitmap_destroy(s_glyph_atlas);
+        s_glyph_cell = NULL;
+        s_glyph_atlas = NULL;
 }
 
 
@@ -615,9 +1663,20 @@ static void init() {
         app_message_register_inbox_dropped(inbox_dropped_callback);
         app_message_register_outbox_failed(outbox_failed_callback);
         app_message_register_outbox_sent(outbox_sent_callback);
+
+        // after the caches are restored, so the worker's word is last
+        worker_start();
+
+        // nothing to show at all; don't wait for the first tick
+        if ( s_live_fetched == 0 )
+                refresh_if_due();
 }
 
 static void deinit() {
+        battery_state_service_unsubscribe();
+        save_stats();
+        worker_hand_over();
+
         // Destroy Window
         window_destroy(s_main_window);
 }
@@ -0,0 +1,147 @@
+#pragma once
+
+// generated by tools/schema.py from messages.json; do not edit
+
+#include <stdint.h>
+
+#define KEY_REFRESH                     0
+#define KEY_WEATHER                     1
+#define KEY_SEQ                         2
+#define KEY_ACK                         3
+#define KEY_TIDES                       4
+#define KEY_STATS                       5
+#define KEY_PACK                        6
+
+#define FORECAST_CHANCE                 128
+
+// value a field holds when the phone had nothing for it
+#define UNKNOWN_INT16                   INT16_MIN
+#define UNKNOWN_INT32                   INT32_MIN
+#define UNKNOWN_INT8                    INT8_MIN
+#define UNKNOWN_UINT16                  UINT16_MAX
+#define UNKNOWN_UINT32                  UINT32_MAX
+#define UNKNOWN_UINT8                   UINT8_MAX
+
+#define FLAG_INVERT                     (1 << 0)
+
+#define FORECAST_CLEAR                  0
+#define FORECAST_CLOUDS                 1
+#define FORECAST_CLOUDY                 2
+#define FORECAST_RAIN                   3
+#define FORECAST_SNOW                   4
+#define FORECAST_SLEET                  5
+#define FORECAST_STORMS                 6
+#define FORECAST_FOG                    7
+#define FORECAST_HAZY                   8
+#define FORECAST_HAZE                   9
+#define FORECAST_DUST                   10
+#define FORECAST_SMOKE                  11
+#define FORECAST_HOT                    12
+#define FORECAST_COLD                   13
+#define FORECAST_COUNT                  14
+#define FORECAST_NAMES { \
+        "clear", \
+        "clouds", \
+        "cloudy", \
+        "rain", \
+        "snow", \
+        "sleet", \
+        "storms", \
+        "fog", \
+        "hazy", \
+        "haze", \
+        "dust", \
+        "smoke", \
+        "hot", \
+        "cold", \
+}
+
+#define POWER_FULL                      0
+#define POWER_SHORT_SPIN                1
+#define POWER_SLOW_REFRESH              2
+#define POWER_SLOW_ROWS                 3
+#define POWER_CLOCK_ONLY                4
+#define POWER_COUNT                     5
+#define POWER_NAMES { \
+        "full", \
+        "short_spin", \
+        "slow_refresh", \
+        "slow_rows", \
+        "clock_only", \
+}
+
+#define PRESENT_FLAGS                   (1 << 0)
+#define PRESENT_SUN                     (1 << 1)
+#define PRESENT_WIND                    (1 << 2)
+#define PRESENT_TEMP                    (1 << 3)
+#define PRESENT_TEMP_HILO               (1 << 4)
+#define PRESENT_FORECAST                (1 << 5)
+#define PRESENT_COORDS                  (1 << 6)
+#define PRESENT_CITY                    (1 << 7)
+
+#define REFRESH_TIDES                   (1 << 0)
+
+// hourly forecast for a point, kept for when the phone has no data; hour i starts start + i * 3600
+typedef struct __attribute__((__packed__)) PackMessage {
+        uint32_t start;
+        uint8_t point;
+        uint8_t count;
+        int32_t lat_e5;
+        int32_t lon_e5;
+        uint16_t wind_dkt[24];
+        uint16_t wind_deg[24];
+        int8_t temp[24];
+        uint8_t forecast[24];
+} PackMessage;
+
+#define PACK_MESSAGE_SIZE               158
+
+// what the face did since start, seconds since epoch
+typedef struct __attribute__((__packed__)) StatsMessage {
+        uint32_t start;
+        uint16_t msgs_in;
+        uint16_t msgs_dropped;
+        uint16_t sends_failed;
+        uint16_t redraws;
+        uint16_t prop_frames;
+        uint16_t refreshes;
+        uint32_t heap_free_min;
+        uint8_t battery_pct;
+        uint8_t power;
+        uint16_t power_changes;
+        uint16_t power_min[5];
+} StatsMessage;
+
+#define STATS_MESSAGE_SIZE              34
+
+// high and low tides, oldest first; tide i is offset_min[i] minutes after start
+typedef struct __attribute__((__packed__)) TidesMessage {
+        uint32_t start;
+        uint8_t count;
+        uint16_t offset_min[32];
+        int16_t height_cm[32];
+} TidesMessage;
+
+#define TIDES_MESSAGE_SIZE              133
+
+// everything a refresh knows; only the groups flagged in present are meaningful
+typedef struct __attribute__((__packed__)) WeatherMessage {
+        uint16_t present;
+        uint8_t flags;
+        uint8_t power_pct[4];
+        uint16_t sunrise_min;
+        uint16_t sunset_min;
+        uint16_t wind_dkt;
+        uint16_t wind_deg;
+        int8_t temp;
+        int8_t temp_hilo;
+        uint8_t forecast;
+        int32_t lat_e5;
+        int32_t lon_e5;
+        char city[24];
+} WeatherMessage;
+
+#define WEATHER_MESSAGE_SIZE            50
+
+#define APP_MESSAGE_IN_SIZE             209    // 1 + 57 + 11 + 140
+#define APP_MESSAGE_OUT_SIZE            59     // 1 + 8 + 9 + 41
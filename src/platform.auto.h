@@ -0,0 +1,25 @@
+#pragma once
+
+// generated by tools/platforms.py from platforms.json; do not edit
+
+#if defined(PBL_PLATFORM_APLITE)
+#define DISPLAY_W                       144
+#define DISPLAY_H                       168
+#define HEAP_BUDGET                     6144
+#define BITMAP_BYTES                    1400
+#define BITMAP_BYTES_PEAK               2128
+#elif defined(PBL_PLATFORM_BASALT)
+#define DISPLAY_W                       144
+#define DISPLAY_H                       168
+#define HEAP_BUDGET                     16384
+#define BITMAP_BYTES                    1544
+#define BITMAP_BYTES_PEAK               2900
+#elif defined(PBL_PLATFORM_DIORITE)
+#define DISPLAY_W                       144
+#define DISPLAY_H                       168
+#define HEAP_BUDGET                     16384
+#define BITMAP_BYTES                    1400
+#define BITMAP_BYTES_PEAK               2128
+#else
+#error "no entry in platforms.json for this platform"
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+// What the face and its background worker both know: the persist keys and
+// layouts the face saves, the messages between the two, and the tide
+// arithmetic.  Include it after pebble.h or pebble_worker.h.
+
+#include "messages.auto.h"
+
+#define KEY_WEATHER_CACHE       12
+#define KEY_TIDE_CACHE          13
+
+// restored weather older than this is flagged on the face
+#define STALE_AFTER_S           (3 * 60 * 60)
+
+// the merged weather as last received, stored under KEY_WEATHER_CACHE
+typedef struct WeatherCache {
+        uint32_t fetched;               // when wind, temperature or a forecast
+                                        // last arrived, seconds since epoch
+        WeatherMessage weather;
+} WeatherCache;
+
+// the tide table as last received, stored under KEY_TIDE_CACHE
+typedef struct TideCache {
+        uint32_t fetched;
+        TidesMessage tides;
+} TideCache;
+
+// Message types between the face and the worker.  An AppWorkerMessage is
+// three uint16s, so the caches themselves stay in persist storage.
+enum {
+        // face -> worker as it opens: send what you have
+        WORKER_HELLO,
+        // both ways; the face sends it as it closes, after its last save.
+        // data0 minutes until the next refresh, data1 refreshes failed in
+        // a row, data2 the wind change in dkt
+        WORKER_SCHEDULE,
+        // worker -> face: data0 the tide height now in cm, data1 the index
+        // of the next tide, data2 WORKER_STALE when the weather is stale
+        WORKER_SNAPSHOT,
+};
+
+#define WORKER_STALE            (1 << 0)
+#define WORKER_NO_TIDE          UINT16_MAX
+
+static inline time_t tide_time(const TidesMessage *tides, int i)
+{
+        return (time_t)tides->start + tides->offset_min[i] * 60;
+}
+
+// index of the first tide after t, or -1 when the table has run out
+static inline int tide_next(const TidesMessage *tides, time_t t)
+{
+        for ( int i = 0; i < tides->count; i++ )
+                if ( tide_time(tides, i) > t )
+                        return i;
+        return -1;
+}
+
+// the height at t on the way to tide next; it follows a half cosine between
+// the tides either side
+static inline int16_t tide_height_cm(const TidesMessage *tides, int next,
+                                     time_t t)
+{
+        if ( next <= 0 || tides->height_cm[next] == UNKNOWN_INT16
+             || tides->height_cm[next - 1] == UNKNOWN_INT16 )
+                return UNKNOWN_INT16;
+
+        int16_t next_cm = tides->height_cm[next];
+        int16_t last_cm = tides->height_cm[next - 1];
+        time_t last = tide_time(tides, next - 1);
+        int32_t span = tide_time(tides, next) - last;
+        int32_t angle = TRIG_MAX_ANGLE / 2 * (t - last) / span;
+        int32_t cosine = cos_lookup(angle);
+
+        return next_cm + (int32_t)(last_cm - next_cm)
+                * (TRIG_MAX_RATIO + cosine) / (2 * TRIG_MAX_RATIO);
+}
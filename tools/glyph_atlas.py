@@ -0,0 +1,355 @@
+#!/usr/bin/env python
+#
+# Rasterises the characters the clock and date rows use from
+# resources/MonospaceTypewriter_48.ttf into one atlas, a strip per size,
+# and writes where each character sits:
+#
+#   resources/images/glyph_atlas.png   white on transparent, one bit deep
+#   src/glyphs.auto.h                  characters, cell sizes and strip rows
+#
+# Every cell in a strip is the font's advance wide, so the watch can place
+# a character without measuring anything.  Files are only rewritten when
+# their contents change.  The build runs this; run it by hand after
+# changing STRIPS.
+#
+#   glyph_atlas.py [--check]
+#
+
+import os
+import struct
+import sys
+
+import pack_atlas
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+FONT = os.path.join('resources', 'MonospaceTypewriter_48.ttf')
+ATLAS = os.path.join('resources', 'images', 'glyph_atlas.png')
+HEADER = os.path.join('src', 'glyphs.auto.h')
+
+# (name, pixels per em, characters); a space is an empty cell and needs no
+# glyph.  The date letters are the ones in the english day names.
+STRIPS = [
+    ('TIME', 24, '0123456789:.'),
+    ('DAY', 17, '0123456789/.adefhimnorstuw'),
+]
+
+# samples per pixel each way; a pixel is set when half of them are inside
+SUPERSAMPLE = 4
+# straight segments per quadratic curve
+CURVE_STEPS = 6
+
+WHITE = (255, 255, 255, 255)
+CLEAR = (0, 0, 0, 0)
+
+# composite glyph flags
+ARG_1_AND_2_ARE_WORDS = 0x0001
+ARGS_ARE_XY_VALUES = 0x0002
+WE_HAVE_A_SCALE = 0x0008
+MORE_COMPONENTS = 0x0020
+WE_HAVE_AN_X_AND_Y_SCALE = 0x0040
+WE_HAVE_A_TWO_BY_TWO = 0x0080
+
+
+class Font(object):
+    '''just enough of a TrueType file to outline a glyph'''
+
+    def __init__(self, data):
+        self.data = data
+        count = struct.unpack('>H', data[4:6])[0]
+        self.tables = {}
+        for i in range(count):
+            tag, _, offset, length = struct.unpack(
+                '>4sIII', data[12 + 16 * i:28 + 16 * i])
+            self.tables[tag.decode('ascii')] = offset
+
+        head = self.tables['head']
+        self.units_per_em = self.u16(head + 18)
+        self.long_loca = self.i16(head + 50) != 0
+        self.h_metrics = self.u16(self.tables['hhea'] + 34)
+        self.cmap = self.read_cmap()
+
+    def u16(self, offset):
+        return struct.unpack('>H', self.data[offset:offset + 2])[0]
+
+    def i16(self, offset):
+        return struct.unpack('>h', self.data[offset:offset + 2])[0]
+
+    def u32(self, offset):
+        return struct.unpack('>I', self.data[offset:offset + 4])[0]
+
+    def read_cmap(self):
+        '''the windows unicode (3, 1) format 4 subtable as {code: glyph}'''
+        cmap = self.tables['cmap']
+        table = None
+        for i in range(self.u16(cmap + 2)):
+            record = cmap + 4 + 8 * i
+            if (self.u16(record), self.u16(record + 2)) == (3, 1):
+                table = cmap + self.u32(record + 4)
+        if table is None or self.u16(table) != 4:
+            raise ValueError('{}: no unicode format 4 cmap'.format(FONT))
+
+        segments = self.u16(table + 6) // 2
+        ends = table + 14
+        starts = ends + 2 * segments + 2
+        deltas = starts + 2 * segments
+        ranges = deltas + 2 * segments
+
+        mapping = {}
+        for i in range(segments):
+            end = self.u16(ends + 2 * i)
+            start = self.u16(starts + 2 * i)
+            delta = self.u16(deltas + 2 * i)
+            range_offset = self.u16(ranges + 2 * i)
+            for code in range(start, min(end, 0xfffe) + 1):
+                if range_offset == 0:
+                    glyph = (code + delta) & 0xffff
+                else:
+                    at = ranges + 2 * i + range_offset + 2 * (code - start)
+                    glyph = self.u16(at)
+                    if glyph:
+                        glyph = (glyph + delta) & 0xffff
+                mapping[code] = glyph
+        return mapping
+
+    def advance(self, glyph):
+        index = min(glyph, self.h_metrics - 1)
+        return self.u16(self.tables['hmtx'] + 4 * index)
+
+    def glyph_offset(self, glyph):
+        loca = self.tables['loca']
+        if self.long_loca:
+            start, end = self.u32(loca + 4 * glyph), self.u32(loca + 4 * glyph + 4)
+        else:
+            start, end = self.u16(loca + 2 * glyph) * 2, self.u16(loca + 2 * glyph + 2) * 2
+        return self.tables['glyf'] + start, end - start
+
+    def contours(self, glyph):
+        '''[[(x, y, on_curve)]] in font units'''
+        offset, length = self.glyph_offset(glyph)
+        if length == 0:
+            return []
+
+        count = self.i16(offset)
+        if count < 0:
+            return self.composite(offset + 10)
+
+        ends = [self.u16(offset + 10 + 2 * i) for i in range(count)]
+        points = ends[-1] + 1 if ends else 0
+        at = offset + 10 + 2 * count
+        at += 2 + self.u16(at)
+
+        flags = []
+        while len(flags) < points:
+            flag = bytearray(self.data[at:at + 1])[0]
+            at += 1
+            repeat = 0
+            if flag & 8:
+                repeat = bytearray(self.data[at:at + 1])[0]
+                at += 1
+            flags.extend([flag] * (repeat + 1))
+
+        flags = flags[:points]
+        xs, at = self.coordinates(at, flags, 2, 16)
+        ys, at = self.coordinates(at, flags, 4, 32)
+
+        result = []
+        first = 0
+        for end in ends:
+            result.append([(xs[i], ys[i], bool(flags[i] & 1))
+                           for i in range(first, end + 1)])
+            first = end + 1
+        return result
+
+    def coordinates(self, at, flags, short, same):
+        '''one axis of a simple glyph's points, stored as deltas'''
+        values = []
+        value = 0
+        for flag in flags:
+            if flag & short:
+                step = bytearray(self.data[at:at + 1])[0]
+                at += 1
+                value += step if flag & same else -step
+            elif not flag & same:
+                value += self.i16(at)
+                at += 2
+            values.append(value)
+        return values, at
+
+    def composite(self, at):
+        result = []
+        while True:
+            flags = self.u16(at)
+            glyph = self.u16(at + 2)
+            at += 4
+            if flags & ARG_1_AND_2_ARE_WORDS:
+                dx, dy = self.i16(at), self.i16(at + 2)
+                at += 4
+            else:
+                dx, dy = struct.unpack('>bb', self.data[at:at + 2])
+                at += 2
+            if not flags & ARGS_ARE_XY_VALUES:
+                dx = dy = 0     # point matching; none of our glyphs use it
+
+            xx, xy, yx, yy = 1.0, 0.0, 0.0, 1.0
+            if flags & WE_HAVE_A_SCALE:
+                xx = yy = self.i16(at) / 16384.0
+                at += 2
+            elif flags & WE_HAVE_AN_X_AND_Y_SCALE:
+                xx, yy = self.i16(at) / 16384.0, self.i16(at + 2) / 16384.0
+                at += 4
+            elif flags & WE_HAVE_A_TWO_BY_TWO:
+                xx, xy, yx, yy = [self.i16(at + 2 * i) / 16384.0
+                                  for i in range(4)]
+                at += 8
+
+            for contour in self.contours(glyph):
+                result.append([(x * xx + y * yx + dx, x * xy + y * yy + dy, on)
+                               for x, y, on in contour])
+            if not flags & MORE_COMPONENTS:
+                return result
+
+
+def outline(contour, scale):
+    '''a closed contour as straight edges in pixels, y growing downwards'''
+    # between two off-curve points there is an implied on-curve one
+    points = []
+    for i, (x, y, on) in enumerate(contour):
+        px, py, pon = contour[i - 1]
+        if not on and not pon:
+            points.append(((x + px) / 2.0, (y + py) / 2.0, True))
+        points.append((x, y, on))
+    if not points:
+        return []
+
+    start = next((i for i, p in enumerate(points) if p[2]), 0)
+    points = points[start:] + points[:start]
+    points.append(points[0])
+
+    line = [(points[0][0], points[0][1])]
+    i = 1
+    while i < len(points):
+        x, y, on = points[i]
+        if on or i + 1 >= len(points):
+            line.append((x, y))
+            i += 1
+            continue
+        x0, y0 = line[-1]
+        x2, y2 = points[i + 1][:2]
+        for step in range(1, CURVE_STEPS + 1):
+            t = step / float(CURVE_STEPS)
+            line.append(((1 - t) ** 2 * x0 + 2 * (1 - t) * t * x + t ** 2 * x2,
+                         (1 - t) ** 2 * y0 + 2 * (1 - t) * t * y + t ** 2 * y2))
+        i += 2
+
+    line = [(x * scale, -y * scale) for x, y in line]
+    return list(zip(line, line[1:]))
+
+
+def rasterise(edges, width, height, left, top):
+    '''1 for every pixel at least half covered, non-zero winding'''
+    rows = []
+    samples = SUPERSAMPLE * SUPERSAMPLE
+    for row in range(height):
+        coverage = [0] * width
+        for sy in range(SUPERSAMPLE):
+            y = top + row + (sy + 0.5) / SUPERSAMPLE
+            crossings = []
+            for (x0, y0), (x1, y1) in edges:
+                if (y0 <= y < y1) or (y1 <= y < y0):
+                    x = x0 + (y - y0) * (x1 - x0) / (y1 - y0)
+                    crossings.append((x, 1 if y1 > y0 else -1))
+            crossings.sort()
+
+            winding = 0
+            for (x, direction), following in zip(crossings, crossings[1:] + [None]):
+                winding += direction
+                if not winding or following is None:
+                    continue
+                for column in range(width):
+                    for sx in range(SUPERSAMPLE):
+                        sample = left + column + (sx + 0.5) / SUPERSAMPLE
+                        if x <= sample < following[0]:
+                            coverage[column] += 1
+        rows.append([1 if c * 2 >= samples else 0 for c in coverage])
+    return rows
+
+
+def strip(font, em, chars):
+    '''the strip's pixel rows, and its cell width, height and baseline'''
+    scale = em / float(font.units_per_em)
+    glyphs = [font.cmap.get(ord(char), 0) for char in chars]
+    width = int(round(max(font.advance(glyph) for glyph in glyphs) * scale))
+
+    outlines = [[edge for contour in font.contours(glyph)
+                 for edge in outline(contour, scale)] for glyph in glyphs]
+    ys = [y for edges in outlines for edge in edges for _, y in edge]
+    top = int(min(ys) // 1)
+    height = int(-(-max(ys) // 1)) - top
+
+    pixels = [[] for _ in range(height)]
+    for char, edges in zip(chars, outlines):
+        cell = rasterise(edges, width, height, 0, top)
+        for y in range(height):
+            pixels[y].extend(WHITE if bit else CLEAR for bit in cell[y])
+    return pixels, width, height, -top
+
+
+def header(strips):
+    lines = ['#pragma once', '',
+             '// generated by tools/glyph_atlas.py from {}; do not edit'.format(
+                 os.path.basename(FONT)), '']
+    for name, chars, y, width, height, baseline in strips:
+        lines.append('#define GLYPH_{}_CHARS {}"{}"'.format(
+            name, ' ' * (16 - len(name)), chars))
+        for field, value in (('Y', y), ('W', width), ('H', height),
+                             ('BASELINE', baseline)):
+            label = 'GLYPH_{}_{}'.format(name, field)
+            lines.append('#define {:<32}{}'.format(label, value))
+        lines.append('')
+    return '\n'.join(lines)
+
+
+def build(root):
+    with open(os.path.join(root, FONT), 'rb') as f:
+        font = Font(f.read())
+
+    rows = []
+    placed = []
+    for name, em, chars in STRIPS:
+        pixels, width, height, baseline = strip(font, em, chars)
+        placed.append((name, chars, len(rows), width, height, baseline))
+        rows.extend(pixels)
+
+    atlas_width = max(len(row) for row in rows)
+    rows = [row + [CLEAR] * (atlas_width - len(row)) for row in rows]
+    return (pack_atlas.write_png(atlas_width, len(rows), rows),
+            header(placed).encode('ascii'))
+
+
+def generate(root=ROOT, check=False):
+    '''returns the list of files that were (or, with check, would be)
+    rewritten'''
+    stale = []
+    atlas, text = build(root)
+    for path, contents in ((ATLAS, atlas), (HEADER, text)):
+        path = os.path.join(root, path)
+        current = None
+        if os.path.exists(path):
+            with open(path, 'rb') as f:
+                current = f.read()
+        if current != contents:
+            stale.append(path)
+            if not check:
+                with open(path, 'wb') as f:
+                    f.write(contents)
+    return stale
+
+
+if __name__ == '__main__':
+    check = '--check' in sys.argv[1:]
+    stale = generate(check=check)
+    for path in stale:
+        print('{} {}'.format('stale' if check else 'wrote',
+                             os.path.relpath(path, ROOT)))
+    sys.exit(1 if check and stale else 0)
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "host.h"
+
+// Runs the face for a number of virtual days and prints what each day cost.
+//
+//   dayboat-bench [-d days] [-s start_epoch] [-r resources_dir]
+//                 [-l loss_percent] [-o offline_after_h]
+//                 [-b drain_percent_per_day] [-q] [-w] [-c close_every_h]
+//                 [-2] [-v]
+//
+// -l drops that share of messages in either direction, to exercise retries.
+// -o takes the phone's data away that many hours in; it still has a fix.
+// -b runs the battery down from full by that much a day, and -q makes every
+// night quiet time, to step through the power stages.
+// -w installs the background worker, and -c closes the face every that many
+// hours and opens it again half an hour later.
+
+static void usage(const char *argv0)
+{
+        fprintf(stderr, "usage: %s [-d days] [-s start_epoch] "
+                "[-r resources_dir] [-l loss_percent] [-o offline_after_h] "
+                "[-b drain_percent_per_day] [-q] [-w] [-c close_every_h] "
+                "[-2] [-v]\n", argv0);
+        exit(2);
+}
+
+int main(int argc, char **argv)
+{
+        int opt;
+        while ( (opt = getopt(argc, argv, "d:s:r:l:o:b:qwc:2v")) != -1 ) {
+                switch ( opt ) {
+                case 'd':
+                        host_options.days = atoi(optarg);
+                        break;
+                case 's':
+                        host_options.start = (time_t)atoll(optarg);
+                        break;
+                case 'r':
+                        host_options.resources_dir = optarg;
+                        break;
+                case 'l':
+                        host_options.loss_percent = atoi(optarg);
+                        break;
+                case 'o':
+                        host_options.offline_after_h = atoi(optarg);
+                        break;
+                case 'b':
+                        host_options.drain_pct_per_day = atoi(optarg);
+                        break;
+                case 'q':
+                        host_options.quiet_nights = true;
+                        break;
+                case 'w':
+                        host_options.worker = true;
+                        break;
+                case 'c':
+                        host_options.close_every_h = atoi(optarg);
+                        break;
+                case '2':
+                        host_options.clock_24h = true;
+                        break;
+                case 'v':
+                        host_options.verbose = true;
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+        if ( host_options.days < 1 )
+                usage(argv[0]);
+
+        // the virtual clock runs in utc so reports are reproducible
+        setenv("TZ", "UTC", 1);
+        tzset();
+
+        host_start();
+        host_run();
+        return 0;
+}
@@ -0,0 +1,40 @@
+#!/usr/bin/env python
+#
+# Writes resource_ids.auto.h for the host build from the media list in
+# appinfo.json, numbering resources from 1 the same way the SDK does.  With a
+# platform, entries whose targetPlatforms leave it out are skipped.
+#
+#   gen_resource_ids.py appinfo.json resource_ids.auto.h [platform]
+#
+
+import json
+import sys
+
+
+def main(appinfo_path, header_path, platform=None):
+    with open(appinfo_path) as f:
+        media = [resource for resource in json.load(f)['resources']['media']
+                 if platform is None
+                 or platform in resource.get('targetPlatforms', [platform])]
+
+    lines = ['#pragma once', '', '// generated from appinfo.json; do not edit', '']
+    for number, resource in enumerate(media, 1):
+        lines.append('#define RESOURCE_ID_{} {}'.format(resource['name'], number))
+
+    lines.append('')
+    lines.append('#define HOST_RESOURCE_FILES { \\')
+    lines.append('        NULL, \\')
+    for resource in media:
+        lines.append('        "{}", \\'.format(resource['file']))
+    lines.append('}')
+    lines.append('')
+
+    with open(header_path, 'w') as f:
+        f.write('\n'.join(lines))
+
+
+if __name__ == '__main__':
+    if len(sys.argv) not in (3, 4):
+        sys.exit('usage: gen_resource_ids.py appinfo.json resource_ids.auto.h'
+                 ' [platform]')
+    main(*sys.argv[1:])
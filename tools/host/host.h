@@ -0,0 +1,69 @@
+#pragma once
+
+// Internals shared by the host stub SDK, the simulated phone and the bench
+// driver.  Nothing in src/ includes this.
+
+#include <pebble.h>
+
+typedef struct HostCounters {
+        uint32_t ticks;
+        uint32_t render_passes;
+        uint32_t layers_drawn;
+        uint32_t draw_calls;
+        uint32_t dirty_px;
+        uint32_t set_text;
+        uint32_t mark_dirty;
+        uint32_t timers_registered;
+        uint32_t timers_fired;
+        uint32_t bitmaps_created;
+        uint32_t bitmap_bytes;
+        uint32_t persist_reads;
+        uint32_t persist_writes;
+        uint32_t persist_bytes;
+        uint32_t outbox_sent;
+        uint32_t outbox_failed;
+        uint32_t inbox_received;
+        uint32_t inbox_dropped;
+        uint32_t inbox_bytes;
+        uint32_t worker_msgs;
+        uint32_t heap_peak;
+} HostCounters;
+
+typedef struct HostOptions {
+        int days;
+        time_t start;
+        bool clock_24h;
+        bool verbose;
+        int loss_percent;
+        int offline_after_h;            // the phone loses data; 0 never
+        int drain_pct_per_day;          // the battery runs down; 0 never
+        bool quiet_nights;              // quiet time 22:00 to 07:00
+        bool worker;                    // worker_src is installed
+        int close_every_h;              // the face closes for a while; 0 never
+        const char *resources_dir;
+        const char *face_library;
+} HostOptions;
+
+extern HostOptions host_options;
+
+// virtual clock and event queue
+typedef void (*HostEventHandler)(void *data);
+
+void host_start(void);
+int64_t host_now_ms(void);
+void host_schedule(uint32_t delay_ms, HostEventHandler handler, void *data);
+
+// hand a serialised dictionary to the watch's inbox after delay_ms
+void host_deliver_inbox(uint32_t delay_ms, const uint8_t *buffer,
+                        uint16_t size);
+
+// runs every session of the face, loading it afresh for each
+void host_run(void);
+
+// simulated phone, see phone.c
+void phone_on_ready(void);
+void phone_on_message(DictionaryIterator *iterator);
+
+// the worker's own main(), renamed at compile time; the face's is
+// pebble_main() in face_library
+int worker_main(void);
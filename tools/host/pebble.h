@@ -0,0 +1,426 @@
+#pragma once
+
+// Host stand-in for the Pebble SDK header.  Only the parts of the API the
+// face actually uses are declared here; the implementations in pebble_host.c
+// record every call so the bench driver can report what a day of ticks costs.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "resource_ids.auto.h"
+
+#if !defined(PBL_PLATFORM_APLITE) && !defined(PBL_PLATFORM_BASALT) \
+    && !defined(PBL_PLATFORM_DIORITE)
+#define PBL_PLATFORM_BASALT
+#endif
+
+#define PBL_SDK_3
+#define PBL_RECT
+#if defined(PBL_PLATFORM_BASALT)
+#define PBL_COLOR
+#else
+#define PBL_BW
+#endif
+
+#ifdef PBL_COLOR
+#define PBL_IF_COLOR_ELSE(if_true, if_false) (if_true)
+#else
+#define PBL_IF_COLOR_ELSE(if_true, if_false) (if_false)
+#endif
+
+#define ARRAY_LENGTH(array) (sizeof((array)) / sizeof((array)[0]))
+
+// logging
+
+typedef enum {
+        APP_LOG_LEVEL_ERROR = 1,
+        APP_LOG_LEVEL_WARNING = 50,
+        APP_LOG_LEVEL_INFO = 100,
+        APP_LOG_LEVEL_DEBUG = 200,
+        APP_LOG_LEVEL_DEBUG_VERBOSE = 255,
+} AppLogLevel;
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number,
+             const char *fmt, ...);
+
+#define APP_LOG(level, fmt, args...) \
+        app_log(level, __FILE__, __LINE__, fmt, ## args)
+
+// geometry and colour
+
+typedef struct GPoint {
+        int16_t x;
+        int16_t y;
+} GPoint;
+
+typedef struct GSize {
+        int16_t w;
+        int16_t h;
+} GSize;
+
+typedef struct GRect {
+        GPoint origin;
+        GSize size;
+} GRect;
+
+#define GPoint(x, y) ((GPoint){(x), (y)})
+#define GSize(w, h) ((GSize){(w), (h)})
+#define GRect(x, y, w, h) ((GRect){{(x), (y)}, {(w), (h)}})
+#define GPointZero GPoint(0, 0)
+
+typedef union GColor8 {
+        uint8_t argb;
+        struct {
+                uint8_t b:2;
+                uint8_t g:2;
+                uint8_t r:2;
+                uint8_t a:2;
+        };
+} GColor8;
+
+typedef GColor8 GColor;
+
+#define GColorClear ((GColor8){.argb = 0x00})
+#define GColorBlack ((GColor8){.argb = 0xC0})
+#define GColorWhite ((GColor8){.argb = 0xFF})
+
+bool gcolor_equal(GColor8 x, GColor8 y);
+
+typedef enum {
+        GCornerNone = 0,
+} GCornerMask;
+
+typedef enum {
+        GTextOverflowModeWordWrap,
+        GTextOverflowModeTrailingEllipsis,
+        GTextOverflowModeFill,
+} GTextOverflowMode;
+
+typedef enum {
+        GTextAlignmentLeft,
+        GTextAlignmentCenter,
+        GTextAlignmentRight,
+} GTextAlignment;
+
+typedef enum {
+        GCompOpAssign,
+        GCompOpAssignInverted,
+        GCompOpOr,
+        GCompOpAnd,
+        GCompOpClear,
+        GCompOpSet,
+} GCompOp;
+
+// fonts
+
+typedef struct HostFont *GFont;
+
+#define FONT_KEY_GOTHIC_14 "RESOURCE_ID_GOTHIC_14"
+#define FONT_KEY_GOTHIC_24_BOLD "RESOURCE_ID_GOTHIC_24_BOLD"
+#define FONT_KEY_GOTHIC_28_BOLD "RESOURCE_ID_GOTHIC_28_BOLD"
+
+GFont fonts_get_system_font(const char *font_key);
+
+// layers and windows
+
+typedef struct Layer Layer;
+typedef struct Window Window;
+typedef struct TextLayer TextLayer;
+typedef struct BitmapLayer BitmapLayer;
+typedef struct GBitmap GBitmap;
+
+typedef void (*WindowHandler)(Window *window);
+
+typedef struct WindowHandlers {
+        WindowHandler load;
+        WindowHandler appear;
+        WindowHandler disappear;
+        WindowHandler unload;
+} WindowHandlers;
+
+Window *window_create(void);
+void window_destroy(Window *window);
+void window_set_window_handlers(Window *window, WindowHandlers handlers);
+void window_set_background_color(Window *window, GColor background_color);
+Layer *window_get_root_layer(const Window *window);
+void window_stack_push(Window *window, bool animated);
+
+typedef struct GContext GContext;
+typedef struct GTextAttributes GTextAttributes;
+typedef void (*LayerUpdateProc)(Layer *layer, GContext *ctx);
+
+Layer *layer_create(GRect frame);
+void layer_destroy(Layer *layer);
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc);
+GRect layer_get_bounds(const Layer *layer);
+GRect layer_get_frame(const Layer *layer);
+void layer_add_child(Layer *parent, Layer *child);
+void layer_mark_dirty(Layer *layer);
+
+TextLayer *text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer *text_layer);
+Layer *text_layer_get_layer(TextLayer *text_layer);
+void text_layer_set_text(TextLayer *text_layer, const char *text);
+const char *text_layer_get_text(TextLayer *text_layer);
+void text_layer_set_background_color(TextLayer *text_layer, GColor color);
+void text_layer_set_text_color(TextLayer *text_layer, GColor color);
+void text_layer_set_font(TextLayer *text_layer, GFont font);
+void text_layer_set_text_alignment(TextLayer *text_layer,
+                                   GTextAlignment text_alignment);
+
+typedef enum GBitmapFormat {
+        GBitmapFormat1Bit = 0,
+        GBitmapFormat8Bit,
+        GBitmapFormat1BitPalette,
+        GBitmapFormat2BitPalette,
+        GBitmapFormat4BitPalette,
+        GBitmapFormat8BitCircular,
+} GBitmapFormat;
+
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id);
+GBitmapFormat gbitmap_get_format(const GBitmap *bitmap);
+GColor *gbitmap_get_palette(const GBitmap *bitmap);
+GBitmap *gbitmap_create_as_sub_bitmap(const GBitmap *base_bitmap,
+                                      GRect sub_rect);
+GRect gbitmap_get_bounds(const GBitmap *bitmap);
+void gbitmap_set_bounds(GBitmap *bitmap, GRect bounds);
+void gbitmap_destroy(GBitmap *bitmap);
+
+BitmapLayer *bitmap_layer_create(GRect frame);
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer);
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer);
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap);
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer,
+                                       GCompOp mode);
+
+// drawing, only inside an update_proc
+
+void graphics_context_set_fill_color(GContext *ctx, GColor color);
+void graphics_context_set_text_color(GContext *ctx, GColor color);
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp mode);
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius,
+                        GCornerMask corner_mask);
+void graphics_draw_text(GContext *ctx, const char *text, GFont font,
+                        GRect box, GTextOverflowMode overflow_mode,
+                        GTextAlignment alignment,
+                        GTextAttributes *text_attributes);
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap,
+                                  GRect rect);
+
+// heap
+
+size_t heap_bytes_free(void);
+size_t heap_bytes_used(void);
+
+// math
+
+#define TRIG_MAX_RATIO 0xffff
+#define TRIG_MAX_ANGLE 0x10000
+
+int32_t sin_lookup(int32_t angle);
+int32_t cos_lookup(int32_t angle);
+
+// persistent storage
+
+#define PERSIST_DATA_MAX_LENGTH 256
+
+typedef int32_t status_t;
+
+typedef enum {
+        S_SUCCESS = 0,
+        E_ERROR = -1,
+        E_INVALID_ARGUMENT = -3,
+        E_DOES_NOT_EXIST = -10,
+} StatusCode;
+
+bool persist_exists(const uint32_t key);
+int persist_read_data(const uint32_t key, void *buffer,
+                      const size_t buffer_size);
+int persist_write_data(const uint32_t key, const void *data,
+                       const size_t size);
+status_t persist_delete(const uint32_t key);
+
+// time
+
+typedef enum {
+        SECOND_UNIT = 1 << 0,
+        MINUTE_UNIT = 1 << 1,
+        HOUR_UNIT = 1 << 2,
+        DAY_UNIT = 1 << 3,
+        MONTH_UNIT = 1 << 4,
+        YEAR_UNIT = 1 << 5,
+} TimeUnits;
+
+typedef void (*TickHandler)(struct tm *tick_time, TimeUnits units_changed);
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+void tick_timer_service_unsubscribe(void);
+
+bool clock_is_24h_style(void);
+
+// the face reads the wall clock through time(); route it to the virtual one
+time_t host_time(time_t *tloc);
+#define time(tloc) host_time(tloc)
+
+uint16_t time_ms(time_t *t_utc, uint16_t *out_ms);
+
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback,
+                             void *callback_data);
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer *timer_handle);
+
+// dictionaries and app messages
+
+typedef enum {
+        TUPLE_BYTE_ARRAY = 0,
+        TUPLE_CSTRING = 1,
+        TUPLE_UINT = 2,
+        TUPLE_INT = 3,
+} TupleType;
+
+typedef struct __attribute__((__packed__)) Tuple {
+        uint32_t key;
+        TupleType type:8;
+        uint16_t length;
+        union {
+                uint8_t data[0];
+                char cstring[0];
+                uint8_t uint8;
+                uint16_t uint16;
+                uint32_t uint32;
+                int8_t int8;
+                int16_t int16;
+                int32_t int32;
+        } value[];
+} Tuple;
+
+typedef struct __attribute__((__packed__)) Dictionary {
+        uint8_t count;
+        Tuple head[];
+} Dictionary;
+
+typedef struct DictionaryIterator {
+        Dictionary *dictionary;
+        const void *end;
+        Tuple *cursor;
+} DictionaryIterator;
+
+typedef enum {
+        DICT_OK = 0,
+        DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+        DICT_INVALID_ARGS = 1 << 2,
+} DictionaryResult;
+
+Tuple *dict_read_begin_from_buffer(DictionaryIterator *iter,
+                                   const uint8_t *buffer, uint16_t size);
+Tuple *dict_read_first(DictionaryIterator *iter);
+Tuple *dict_read_next(DictionaryIterator *iter);
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t *buffer,
+                                  const uint16_t size);
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key,
+                                 const uint8_t *data, const uint16_t size);
+DictionaryResult dict_write_cstring(DictionaryIterator *iter,
+                                    const uint32_t key, const char *cstring);
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key,
+                                const void *integer, const uint8_t width_bytes,
+                                const bool is_signed);
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key,
+                                  const uint8_t value);
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key,
+                                   const uint16_t value);
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key,
+                                  const int32_t value);
+uint32_t dict_write_end(DictionaryIterator *iter);
+
+typedef enum {
+        APP_MSG_OK = 0,
+        APP_MSG_SEND_TIMEOUT = 1 << 1,
+        APP_MSG_SEND_REJECTED = 1 << 2,
+        APP_MSG_NOT_CONNECTED = 1 << 3,
+        APP_MSG_APP_NOT_RUNNING = 1 << 4,
+        APP_MSG_INVALID_ARGS = 1 << 5,
+        APP_MSG_BUSY = 1 << 6,
+        APP_MSG_BUFFER_OVERFLOW = 1 << 7,
+        APP_MSG_ALREADY_RELEASED = 1 << 9,
+        APP_MSG_CALLBACK_ALREADY_REGISTERED = 1 << 10,
+        APP_MSG_CALLBACK_NOT_REGISTERED = 1 << 11,
+        APP_MSG_OUT_OF_MEMORY = 1 << 12,
+        APP_MSG_CLOSED = 1 << 13,
+        APP_MSG_INTERNAL_ERROR = 1 << 14,
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator,
+                                        void *context);
+typedef void (*AppMessageInboxDropped)(AppMessageResult reason,
+                                       void *context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iterator,
+                                     void *context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iterator,
+                                       AppMessageResult reason,
+                                       void *context);
+
+AppMessageResult app_message_open(const uint32_t size_inbound,
+                                  const uint32_t size_outbound);
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+AppMessageResult app_message_outbox_send(void);
+AppMessageInboxReceived app_message_register_inbox_received(
+                AppMessageInboxReceived received_callback);
+AppMessageInboxDropped app_message_register_inbox_dropped(
+                AppMessageInboxDropped dropped_callback);
+AppMessageOutboxSent app_message_register_outbox_sent(
+                AppMessageOutboxSent sent_callback);
+AppMessageOutboxFailed app_message_register_outbox_failed(
+                AppMessageOutboxFailed failed_callback);
+
+// background worker
+
+typedef enum {
+        APP_WORKER_RESULT_SUCCESS = 0,
+        APP_WORKER_RESULT_NO_WORKER = 1,
+        APP_WORKER_RESULT_DIFFERENT_APP = 2,
+        APP_WORKER_RESULT_NOT_RUNNING = 3,
+        APP_WORKER_RESULT_ALREADY_RUNNING = 4,
+        APP_WORKER_RESULT_ASKING_CONFIRMATION = 5,
+} AppWorkerResult;
+
+typedef struct {
+        uint16_t data0;
+        uint16_t data1;
+        uint16_t data2;
+} AppWorkerMessage;
+
+typedef void (*AppWorkerMessageHandler)(uint16_t type,
+                                        AppWorkerMessage *data);
+
+bool app_worker_is_running(void);
+AppWorkerResult app_worker_launch(void);
+bool app_worker_message_subscribe(AppWorkerMessageHandler handler);
+bool app_worker_message_unsubscribe(void);
+void app_worker_send_message(uint8_t type, AppWorkerMessage *data);
+
+// battery and quiet time
+
+typedef struct {
+        uint8_t charge_percent;
+        bool is_charging;
+        bool is_plugged;
+} BatteryChargeState;
+
+typedef void (*BatteryStateHandler)(BatteryChargeState charge);
+
+void battery_state_service_subscribe(BatteryStateHandler handler);
+void battery_state_service_unsubscribe(void);
+BatteryChargeState battery_state_service_peek(void);
+bool quiet_time_is_active(void);
+
+// event loop
+
+void app_event_loop(void);
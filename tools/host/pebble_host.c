@@ -0,0 +1,1360 @@
+#include <dlfcn.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include "host.h"
+
+// rough sizes of the firmware objects on the watch, so heap figures are in
+// the same ballpark as the real thing rather than host pointer sizes
+#define FW_WINDOW_SIZE          120
+#define FW_LAYER_SIZE           44
+#define FW_TEXT_LAYER_SIZE      80
+#define FW_BITMAP_LAYER_SIZE    56
+#define FW_GBITMAP_SIZE         28
+
+#if defined(PBL_PLATFORM_APLITE)
+#define HOST_HEAP_SIZE          (24 * 1024)
+#else
+#define HOST_HEAP_SIZE          (64 * 1024)
+#endif
+
+#ifndef HOST_RESOURCES_DIR
+#define HOST_RESOURCES_DIR      "resources"
+#endif
+
+#define HOST_MAX_EVENTS         256
+#define HOST_MAX_PERSIST_KEYS   64
+#define HOST_RADIO_LATENCY_MS   120
+#define HOST_WORKER_STACK       (256 * 1024)
+#define HOST_CLOSED_MS          (30 * 60 * 1000)        // each -c close
+
+#ifndef HOST_FACE_LIBRARY
+#define HOST_FACE_LIBRARY       "libface.so"
+#endif
+
+enum {
+        LAYER_KIND_PLAIN,
+        LAYER_KIND_TEXT,
+        LAYER_KIND_BITMAP,
+};
+
+struct Layer {
+        GRect frame;
+        Layer *parent;
+        Layer *first_child;
+        Layer *next_sibling;
+        uint8_t kind;
+        bool marked;
+        LayerUpdateProc update_proc;
+};
+
+struct GContext {
+        GColor fill_color;
+        GColor text_color;
+        GCompOp compositing_mode;
+};
+
+struct Window {
+        Layer root;
+        WindowHandlers handlers;
+        GColor background_color;
+        bool loaded;
+};
+
+struct TextLayer {
+        Layer layer;
+        const char *text;
+        GColor background_color;
+        GColor text_color;
+        GFont font;
+        GTextAlignment alignment;
+};
+
+struct GBitmap {
+        GSize size;
+        GRect bounds;
+        uint32_t bytes;
+        GBitmapFormat format;
+        GColor *palette;        // own_palette, or the base bitmap's
+        GColor own_palette[16];
+};
+
+struct BitmapLayer {
+        Layer layer;
+        const GBitmap *bitmap;
+        GCompOp compositing_mode;
+};
+
+struct AppTimer {
+        int64_t at_ms;
+        HostEventHandler handler;
+        void *data;
+        bool active;
+        bool is_app_timer;
+};
+
+typedef struct HostPersist {
+        uint32_t key;
+        uint16_t size;
+        bool used;
+        uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} HostPersist;
+
+typedef struct HostInbox {
+        uint16_t size;
+        uint8_t data[];
+} HostInbox;
+
+typedef struct HostWorkerMessage {
+        bool to_worker;
+        uint16_t type;
+        AppWorkerMessage data;
+} HostWorkerMessage;
+
+HostOptions host_options = {
+        .days = 3,
+        .start = 1503792000,    // 2017-08-27 00:00 UTC
+        .resources_dir = HOST_RESOURCES_DIR,
+        .face_library = HOST_FACE_LIBRARY,
+};
+
+HostCounters host_day;
+HostCounters host_total;
+
+static int64_t s_now_ms;
+static struct AppTimer s_events[HOST_MAX_EVENTS];
+static HostPersist s_persist[HOST_MAX_PERSIST_KEYS];
+static Window *s_top_window;
+static bool s_dirty;
+static size_t s_heap_used;
+
+static TickHandler s_tick_handler;
+static TimeUnits s_tick_units;
+static BatteryStateHandler s_battery_handler;
+static uint8_t s_battery_told;          // last percent the handler heard
+
+static uint8_t *s_inbox_buffer;
+static uint32_t s_inbox_size;
+static uint8_t *s_outbox_buffer;
+static uint32_t s_outbox_size;
+static bool s_outbox_busy;
+static DictionaryIterator s_outbox_iter;
+static AppMessageInboxReceived s_inbox_received;
+static AppMessageInboxDropped s_inbox_dropped;
+static AppMessageOutboxSent s_outbox_sent;
+static AppMessageOutboxFailed s_outbox_failed;
+static uint32_t s_radio_seed = 2463534242u;
+
+static AppWorkerMessageHandler s_face_worker_handler;
+static AppWorkerMessageHandler s_worker_handler;
+static bool s_worker_running;
+static bool s_in_worker;                // the worker made this call
+static ucontext_t s_host_context;
+static ucontext_t s_worker_context;
+static char *s_worker_stack;
+
+static int64_t s_end_ms;
+static int64_t s_next_tick_ms;
+static int64_t s_day_end_ms;
+static int s_day = 1;
+
+static const char *s_resource_files[] = HOST_RESOURCE_FILES;
+
+// heap accounting
+
+static void *host_alloc(size_t charged, size_t real)
+{
+        size_t *block = calloc(1, sizeof(size_t) + real);
+        block[0] = charged;
+        s_heap_used += charged;
+        if ( s_heap_used > host_day.heap_peak )
+                host_day.heap_peak = s_heap_used;
+        if ( s_heap_used > HOST_HEAP_SIZE )
+                fprintf(stderr, "host: heap exhausted (%zu of %d bytes)\n",
+                        s_heap_used, HOST_HEAP_SIZE);
+        return block + 1;
+}
+
+static void host_free(void *ptr)
+{
+        if ( !ptr )
+                return;
+        size_t *block = (size_t *)ptr - 1;
+        s_heap_used -= block[0];
+        free(block);
+}
+
+size_t heap_bytes_used(void)
+{
+        return s_heap_used;
+}
+
+size_t heap_bytes_free(void)
+{
+        return s_heap_used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - s_heap_used : 0;
+}
+
+// math
+
+int32_t sin_lookup(int32_t angle)
+{
+        return (int32_t)lround(TRIG_MAX_RATIO
+                 * sin(2 * M_PI * angle / TRIG_MAX_ANGLE));
+}
+
+int32_t cos_lookup(int32_t angle)
+{
+        return (int32_t)lround(TRIG_MAX_RATIO
+                 * cos(2 * M_PI * angle / TRIG_MAX_ANGLE));
+}
+
+// logging and misc
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number,
+             const char *fmt, ...)
+{
+        if ( !host_options.verbose )
+                return;
+
+        va_list args;
+        va_start(args, fmt);
+        fprintf(stderr, "[%lld] %s:%d ", (long long)s_now_ms,
+                src_filename, src_line_number);
+        vfprintf(stderr, fmt, args);
+        fputc('\n', stderr);
+        va_end(args);
+}
+
+bool gcolor_equal(GColor8 x, GColor8 y)
+{
+        return x.argb == y.argb;
+}
+
+GFont fonts_get_system_font(const char *font_key)
+{
+        return (GFont)font_key;
+}
+
+bool clock_is_24h_style(void)
+{
+        return host_options.clock_24h;
+}
+
+// virtual clock and events
+
+int64_t host_now_ms(void)
+{
+        return s_now_ms;
+}
+
+time_t host_time(time_t *tloc)
+{
+        time_t now = (time_t)(s_now_ms / 1000);
+        if ( tloc )
+                *tloc = now;
+        return now;
+}
+
+uint16_t time_ms(time_t *t_utc, uint16_t *out_ms)
+{
+        uint16_t ms = (uint16_t)(s_now_ms % 1000);
+        host_time(t_utc);
+        if ( out_ms )
+                *out_ms = ms;
+        return ms;
+}
+
+static struct AppTimer *host_event_add(uint32_t delay_ms,
+                                       HostEventHandler handler, void *data)
+{
+        for ( int i = 0; i < HOST_MAX_EVENTS; i++ ) {
+                if ( !s_events[i].active ) {
+                        s_events[i] = (struct AppTimer) {
+                                .at_ms = s_now_ms + delay_ms,
+                                .handler = handler,
+                                .data = data,
+                                .active = true,
+                        };
+                        return &s_events[i];
+                }
+        }
+        fprintf(stderr, "host: event queue full\n");
+        exit(1);
+}
+
+void host_schedule(uint32_t delay_ms, HostEventHandler handler, void *data)
+{
+        host_event_add(delay_ms, handler, data);
+}
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback,
+                             void *callback_data)
+{
+        host_day.timers_registered++;
+        AppTimer *timer = host_event_add(timeout_ms, callback, callback_data);
+        timer->is_app_timer = true;
+        return timer;
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms)
+{
+        if ( !timer_handle || !timer_handle->active )
+                return false;
+        timer_handle->at_ms = s_now_ms + new_timeout_ms;
+        return true;
+}
+
+void app_timer_cancel(AppTimer *timer_handle)
+{
+        if ( timer_handle )
+                timer_handle->active = false;
+}
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler)
+{
+        s_tick_units = tick_units;
+        s_tick_handler = handler;
+}
+
+void tick_timer_service_unsubscribe(void)
+{
+        s_tick_handler = NULL;
+}
+
+// layers and windows
+
+static void layer_init(Layer *layer, GRect frame, uint8_t kind)
+{
+        layer->frame = frame;
+        layer->kind = kind;
+}
+
+static void layer_remove(Layer *layer)
+{
+        Layer *parent = layer->parent;
+        if ( !parent )
+                return;
+        Layer **link = &parent->first_child;
+        while ( *link && *link != layer )
+                link = &(*link)->next_sibling;
+        if ( *link )
+                *link = layer->next_sibling;
+        layer->parent = NULL;
+        layer->next_sibling = NULL;
+}
+
+Window *window_create(void)
+{
+        Window *window = host_alloc(FW_WINDOW_SIZE, sizeof(Window));
+        layer_init(&window->root, GRect(0, 0, 144, 168), LAYER_KIND_PLAIN);
+        window->background_color = GColorWhite;
+        return window;
+}
+
+void window_destroy(Window *window)
+{
+        if ( window && window->loaded && window->handlers.unload ) {
+                window->loaded = false;
+                window->handlers.unload(window);
+        }
+        if ( s_top_window == window )
+                s_top_window = NULL;
+        host_free(window);
+}
+
+void window_set_window_handlers(Window *window, WindowHandlers handlers)
+{
+        window->handlers = handlers;
+}
+
+void window_set_background_color(Window *window, GColor background_color)
+{
+        window->background_color = background_color;
+        layer_mark_dirty(&window->root);
+}
+
+Layer *window_get_root_layer(const Window *window)
+{
+        return (Layer *)&window->root;
+}
+
+void window_stack_push(Window *window, bool animated)
+{
+        s_top_window = window;
+        if ( !window->loaded && window->handlers.load ) {
+                window->loaded = true;
+                window->handlers.load(window);
+        }
+        if ( window->handlers.appear )
+                window->handlers.appear(window);
+        layer_mark_dirty(&window->root);
+}
+
+Layer *layer_create(GRect frame)
+{
+        Layer *layer = host_alloc(FW_LAYER_SIZE, sizeof(Layer));
+        layer_init(layer, frame, LAYER_KIND_PLAIN);
+        return layer;
+}
+
+void layer_destroy(Layer *layer)
+{
+        if ( !layer )
+                return;
+        layer_remove(layer);
+        host_free(layer);
+}
+
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc)
+{
+        layer->update_proc = update_proc;
+        layer_mark_dirty(layer);
+}
+
+GRect layer_get_bounds(const Layer *layer)
+{
+        return GRect(0, 0, layer->frame.size.w, layer->frame.size.h);
+}
+
+GRect layer_get_frame(const Layer *layer)
+{
+        return layer->frame;
+}
+
+void layer_add_child(Layer *parent, Layer *child)
+{
+        layer_remove(child);
+        child->parent = parent;
+        Layer **link = &parent->first_child;
+        while ( *link )
+                link = &(*link)->next_sibling;
+        *link = child;
+        layer_mark_dirty(child);
+}
+
+void layer_mark_dirty(Layer *layer)
+{
+        host_day.mark_dirty++;
+        if ( !layer->marked ) {
+                layer->marked = true;
+                host_day.dirty_px += layer->frame.size.w * layer->frame.size.h;
+        }
+        s_dirty = true;
+}
+
+TextLayer *text_layer_create(GRect frame)
+{
+        TextLayer *text_layer = host_alloc(FW_TEXT_LAYER_SIZE,
+                                           sizeof(TextLayer));
+        layer_init(&text_layer->layer, frame, LAYER_KIND_TEXT);
+        text_layer->background_color = GColorWhite;
+        text_layer->text_color = GColorBlack;
+        return text_layer;
+}
+
+void text_layer_destroy(TextLayer *text_layer)
+{
+        if ( !text_layer )
+                return;
+        layer_remove(&text_layer->layer);
+        host_free(text_layer);
+}
+
+Layer *text_layer_get_layer(TextLayer *text_layer)
+{
+        return &text_layer->layer;
+}
+
+void text_layer_set_text(TextLayer *text_layer, const char *text)
+{
+        host_day.set_text++;
+        text_layer->text = text;
+        if ( host_options.verbose )
+                fprintf(stderr, "[%lld] text %d,%d: %s\n", (long long)s_now_ms,
+                        text_layer->layer.frame.origin.x,
+                        text_layer->layer.frame.origin.y, text);
+        layer_mark_dirty(&text_layer->layer);
+}
+
+const char *text_layer_get_text(TextLayer *text_layer)
+{
+        return text_layer->text;
+}
+
+void text_layer_set_background_color(TextLayer *text_layer, GColor color)
+{
+        text_layer->background_color = color;
+        layer_mark_dirty(&text_layer->layer);
+}
+
+void text_layer_set_text_color(TextLayer *text_layer, GColor color)
+{
+        text_layer->text_color = color;
+        layer_mark_dirty(&text_layer->layer);
+}
+
+void text_layer_set_font(TextLayer *text_layer, GFont font)
+{
+        text_layer->font = font;
+        layer_mark_dirty(&text_layer->layer);
+}
+
+void text_layer_set_text_alignment(TextLayer *text_layer,
+                                   GTextAlignment text_alignment)
+{
+        text_layer->alignment = text_alignment;
+        layer_mark_dirty(&text_layer->layer);
+}
+
+// bitmaps
+
+static uint32_t png_read_be32(const uint8_t *p)
+{
+        return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// decoded size of a png resource the way the firmware would hold it:
+// 1 bit per pixel with word-aligned rows on aplite, palettised on colour
+static uint32_t png_decoded_bytes(const char *file, GSize *size,
+                                  GBitmapFormat *format)
+{
+        char path[512];
+        uint8_t header[64];
+        snprintf(path, sizeof(path), "%s/%s", host_options.resources_dir,
+                 file);
+
+        FILE *f = fopen(path, "rb");
+        if ( !f ) {
+                fprintf(stderr, "host: missing resource %s\n", path);
+                exit(1);
+        }
+        size_t n = fread(header, 1, sizeof(header), f);
+        fclose(f);
+        if ( n < 33 ) {
+                fprintf(stderr, "host: bad png %s\n", path);
+                exit(1);
+        }
+
+        uint32_t w = png_read_be32(header + 16);
+        uint32_t h = png_read_be32(header + 20);
+        uint8_t depth = header[24];
+        *size = GSize(w, h);
+
+#if defined(PBL_BW)
+        (void)depth;
+        *format = GBitmapFormat1Bit;
+        return ((w + 31) / 32) * 4 * h;
+#else
+        uint32_t bits = depth > 4 ? 8 : depth;
+        *format = bits == 1 ? GBitmapFormat1BitPalette
+                : bits == 2 ? GBitmapFormat2BitPalette
+                : bits == 4 ? GBitmapFormat4BitPalette : GBitmapFormat8Bit;
+        return ((w * bits + 7) / 8) * h + (1u << bits);
+#endif
+}
+
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id)
+{
+        size_t count = sizeof(s_resource_files) / sizeof(s_resource_files[0]);
+        if ( resource_id == 0 || resource_id >= count )
+                return NULL;
+
+        GSize size;
+        GBitmapFormat format;
+        uint32_t bytes = png_decoded_bytes(s_resource_files[resource_id],
+                                           &size, &format);
+        GBitmap *bitmap = host_alloc(FW_GBITMAP_SIZE + bytes, sizeof(GBitmap));
+        bitmap->size = size;
+        bitmap->bounds = (GRect){ GPointZero, size };
+        bitmap->bytes = bytes;
+        bitmap->format = format;
+        bitmap->palette = format == GBitmapFormat1Bit
+                          || format == GBitmapFormat8Bit
+                          ? NULL : bitmap->own_palette;
+
+        host_day.bitmaps_created++;
+        host_day.bitmap_bytes += bytes;
+        return bitmap;
+}
+
+// shares the base bitmap's pixels, so only the header is allocated
+GBitmap *gbitmap_create_as_sub_bitmap(const GBitmap *base_bitmap,
+                                      GRect sub_rect)
+{
+        GBitmap *bitmap = host_alloc(FW_GBITMAP_SIZE, sizeof(GBitmap));
+        bitmap->size = base_bitmap->size;
+        bitmap->bounds = sub_rect;
+        bitmap->bytes = 0;
+        bitmap->format = base_bitmap->format;
+        bitmap->palette = base_bitmap->palette;
+        return bitmap;
+}
+
+GBitmapFormat gbitmap_get_format(const GBitmap *bitmap)
+{
+        return bitmap->format;
+}
+
+GColor *gbitmap_get_palette(const GBitmap *bitmap)
+{
+        return bitmap->palette;
+}
+
+GRect gbitmap_get_bounds(const GBitmap *bitmap)
+{
+        return bitmap->bounds;
+}
+
+void gbitmap_set_bounds(GBitmap *bitmap, GRect bounds)
+{
+        bitmap->bounds = bounds;
+}
+
+void gbitmap_destroy(GBitmap *bitmap)
+{
+        host_free(bitmap);
+}
+
+BitmapLayer *bitmap_layer_create(GRect frame)
+{
+        BitmapLayer *bitmap_layer = host_alloc(FW_BITMAP_LAYER_SIZE,
+                                               sizeof(BitmapLayer));
+        layer_init(&bitmap_layer->layer, frame, LAYER_KIND_BITMAP);
+        return bitmap_layer;
+}
+
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer)
+{
+        if ( !bitmap_layer )
+                return;
+        layer_remove(&bitmap_layer->layer);
+        host_free(bitmap_layer);
+}
+
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer)
+{
+        return (Layer *)&bitmap_layer->layer;
+}
+
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap)
+{
+        bitmap_layer->bitmap = bitmap;
+        layer_mark_dirty(&bitmap_layer->layer);
+}
+
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer,
+                                       GCompOp mode)
+{
+        bitmap_layer->compositing_mode = mode;
+        layer_mark_dirty(&bitmap_layer->layer);
+}
+
+// the firmware re-renders the whole layer tree whenever anything is dirty
+// drawing only counts calls; nothing is rasterised
+
+void graphics_context_set_fill_color(GContext *ctx, GColor color)
+{
+        ctx->fill_color = color;
+}
+
+void graphics_context_set_text_color(GContext *ctx, GColor color)
+{
+        ctx->text_color = color;
+}
+
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp mode)
+{
+        ctx->compositing_mode = mode;
+}
+
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius,
+                        GCornerMask corner_mask)
+{
+        host_day.draw_calls++;
+}
+
+void graphics_draw_text(GContext *ctx, const char *text, GFont font,
+                        GRect box, GTextOverflowMode overflow_mode,
+                        GTextAlignment alignment,
+                        GTextAttributes *text_attributes)
+{
+        host_day.draw_calls++;
+}
+
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap,
+                                  GRect rect)
+{
+        host_day.draw_calls++;
+}
+
+static void render_layer(Layer *layer)
+{
+        host_day.layers_drawn++;
+        layer->marked = false;
+        if ( layer->update_proc ) {
+                GContext ctx = { GColorBlack, GColorBlack, GCompOpAssign };
+                layer->update_proc(layer, &ctx);
+        }
+        for ( Layer *child = layer->first_child; child;
+              child = child->next_sibling )
+                render_layer(child);
+}
+
+static void render(void)
+{
+        if ( !s_dirty || !s_top_window )
+                return;
+        s_dirty = false;
+        host_day.render_passes++;
+        render_layer(&s_top_window->root);
+}
+
+// persistent storage
+
+static HostPersist *persist_find(uint32_t key)
+{
+        for ( int i = 0; i < HOST_MAX_PERSIST_KEYS; i++ )
+                if ( s_persist[i].used && s_persist[i].key == key )
+                        return &s_persist[i];
+        return NULL;
+}
+
+bool persist_exists(const uint32_t key)
+{
+        return persist_find(key) != NULL;
+}
+
+int persist_read_data(const uint32_t key, void *buffer,
+                      const size_t buffer_size)
+{
+        host_day.persist_reads++;
+        HostPersist *entry = persist_find(key);
+        if ( !entry )
+                return E_DOES_NOT_EXIST;
+        size_t n = entry->size < buffer_size ? entry->size : buffer_size;
+        memcpy(buffer, entry->data, n);
+        return (int)n;
+}
+
+int persist_write_data(const uint32_t key, const void *data,
+                       const size_t size)
+{
+        if ( size > PERSIST_DATA_MAX_LENGTH )
+                return E_INVALID_ARGUMENT;
+
+        HostPersist *entry = persist_find(key);
+        for ( int i = 0; !entry && i < HOST_MAX_PERSIST_KEYS; i++ )
+                if ( !s_persist[i].used )
+                        entry = &s_persist[i];
+        if ( !entry )
+                return E_ERROR;
+
+        entry->used = true;
+        entry->key = key;
+        entry->size = (uint16_t)size;
+        memcpy(entry->data, data, size);
+
+        host_day.persist_writes++;
+        host_day.persist_bytes += size;
+        return (int)size;
+}
+
+status_t persist_delete(const uint32_t key)
+{
+        HostPersist *entry = persist_find(key);
+        if ( !entry )
+                return E_DOES_NOT_EXIST;
+        entry->used = false;
+        return S_SUCCESS;
+}
+
+// dictionaries
+
+static Tuple *tuple_next(const Tuple *tuple)
+{
+        return (Tuple *)((const uint8_t *)tuple + sizeof(Tuple)
+                         + tuple->length);
+}
+
+Tuple *dict_read_begin_from_buffer(DictionaryIterator *iter,
+                                   const uint8_t *buffer, uint16_t size)
+{
+        iter->dictionary = (Dictionary *)buffer;
+        iter->end = buffer + size;
+        iter->cursor = iter->dictionary->head;
+        return dict_read_first(iter);
+}
+
+Tuple *dict_read_first(DictionaryIterator *iter)
+{
+        iter->cursor = iter->dictionary->head;
+        if ( iter->dictionary->count == 0 )
+                return NULL;
+        return iter->cursor;
+}
+
+Tuple *dict_read_next(DictionaryIterator *iter)
+{
+        Tuple *next = tuple_next(iter->cursor);
+        if ( (const void *)next >= iter->end )
+                return NULL;
+        iter->cursor = next;
+        return next;
+}
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key)
+{
+        Tuple *tuple = iter->dictionary->head;
+        for ( int i = 0; i < iter->dictionary->count; i++ ) {
+                if ( tuple->key == key )
+                        return tuple;
+                tuple = tuple_next(tuple);
+        }
+        return NULL;
+}
+
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t *buffer,
+                                  const uint16_t size)
+{
+        if ( !iter || !buffer || size < sizeof(Dictionary) )
+                return DICT_INVALID_ARGS;
+        iter->dictionary = (Dictionary *)buffer;
+        iter->dictionary->count = 0;
+        iter->end = buffer + size;
+        iter->cursor = iter->dictionary->head;
+        return DICT_OK;
+}
+
+static DictionaryResult dict_write_tuple(DictionaryIterator *iter,
+                                         uint32_t key, TupleType type,
+                                         const void *data, uint16_t length)
+{
+        uint8_t *at = (uint8_t *)iter->cursor;
+        if ( at + sizeof(Tuple) + length > (const uint8_t *)iter->end )
+                return DICT_NOT_ENOUGH_STORAGE;
+        iter->cursor->key = key;
+        iter->cursor->type = type;
+        iter->cursor->length = length;
+        memcpy(iter->cursor->value->data, data, length);
+        iter->cursor = tuple_next(iter->cursor);
+        iter->dictionary->count++;
+        return DICT_OK;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key,
+                                 const uint8_t *data, const uint16_t size)
+{
+        return dict_write_tuple(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_cstring(DictionaryIterator *iter,
+                                    const uint32_t key, const char *cstring)
+{
+        return dict_write_tuple(iter, key, TUPLE_CSTRING, cstring,
+                                (uint16_t)(strlen(cstring) + 1));
+}
+
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key,
+                                const void *integer, const uint8_t width_bytes,
+                                const bool is_signed)
+{
+        return dict_write_tuple(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT,
+                                integer, width_bytes);
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key,
+                                  const uint8_t value)
+{
+        return dict_write_int(iter, key, &value, 1, false);
+}
+
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key,
+                                   const uint16_t value)
+{
+        return dict_write_int(iter, key, &value, 2, false);
+}
+
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key,
+                                  const int32_t value)
+{
+        return dict_write_int(iter, key, &value, 4, true);
+}
+
+uint32_t dict_write_end(DictionaryIterator *iter)
+{
+        uint32_t size = (uint32_t)((uint8_t *)iter->cursor
+                                   - (uint8_t *)iter->dictionary);
+        iter->end = iter->cursor;
+        return size;
+}
+
+// app messages
+
+AppMessageResult app_message_open(const uint32_t size_inbound,
+                                  const uint32_t size_outbound)
+{
+        if ( s_inbox_buffer )
+                return APP_MSG_INVALID_ARGS;
+        s_inbox_size = size_inbound;
+        s_outbox_size = size_outbound;
+        s_inbox_buffer = host_alloc(size_inbound, size_inbound);
+        s_outbox_buffer = host_alloc(size_outbound, size_outbound);
+        return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator)
+{
+        if ( !s_outbox_buffer )
+                return APP_MSG_INVALID_ARGS;
+        if ( s_outbox_busy )
+                return APP_MSG_BUSY;
+        dict_write_begin(&s_outbox_iter, s_outbox_buffer,
+                         (uint16_t)s_outbox_size);
+        *iterator = &s_outbox_iter;
+        return APP_MSG_OK;
+}
+
+// true for roughly loss_percent of messages; xorshift so runs repeat
+static bool radio_lost(void)
+{
+        s_radio_seed ^= s_radio_seed << 13;
+        s_radio_seed ^= s_radio_seed >> 17;
+        s_radio_seed ^= s_radio_seed << 5;
+        return (int)(s_radio_seed % 100) < host_options.loss_percent;
+}
+
+static void outbox_complete(void *data)
+{
+        DictionaryIterator iter;
+        dict_read_begin_from_buffer(&iter, s_outbox_buffer,
+                                    (uint16_t)s_outbox_size);
+        s_outbox_busy = false;
+        if ( radio_lost() ) {
+                host_day.outbox_failed++;
+                if ( s_outbox_failed )
+                        s_outbox_failed(&iter, APP_MSG_SEND_TIMEOUT, NULL);
+                return;
+        }
+        host_day.outbox_sent++;
+        if ( s_outbox_sent )
+                s_outbox_sent(&iter, NULL);
+        phone_on_message(&iter);
+}
+
+AppMessageResult app_message_outbox_send(void)
+{
+        if ( !s_outbox_buffer )
+                return APP_MSG_INVALID_ARGS;
+        if ( s_outbox_busy ) {
+                host_day.outbox_failed++;
+                return APP_MSG_BUSY;
+        }
+        dict_write_end(&s_outbox_iter);
+        s_outbox_busy = true;
+        host_schedule(HOST_RADIO_LATENCY_MS, outbox_complete, NULL);
+        return APP_MSG_OK;
+}
+
+static void inbox_arrive(void *data)
+{
+        HostInbox *message = data;
+
+        if ( radio_lost() ) {
+                // never reached the watch; the phone times out waiting
+                host_day.inbox_dropped++;
+        } else if ( !s_inbox_buffer || message->size > s_inbox_size ) {
+                host_day.inbox_dropped++;
+                if ( s_inbox_dropped )
+                        s_inbox_dropped(APP_MSG_BUFFER_OVERFLOW, NULL);
+        } else {
+                DictionaryIterator iter;
+                memcpy(s_inbox_buffer, message->data, message->size);
+                dict_read_begin_from_buffer(&iter, s_inbox_buffer,
+                                            message->size);
+                host_day.inbox_received++;
+                host_day.inbox_bytes += message->size;
+                if ( s_inbox_received )
+                        s_inbox_received(&iter, NULL);
+        }
+        free(message);
+}
+
+void host_deliver_inbox(uint32_t delay_ms, const uint8_t *buffer,
+                        uint16_t size)
+{
+        HostInbox *message = malloc(sizeof(HostInbox) + size);
+        message->size = size;
+        memcpy(message->data, buffer, size);
+        host_schedule(delay_ms + HOST_RADIO_LATENCY_MS, inbox_arrive,
+                      message);
+}
+
+AppMessageInboxReceived app_message_register_inbox_received(
+                AppMessageInboxReceived received_callback)
+{
+        AppMessageInboxReceived old = s_inbox_received;
+        s_inbox_received = received_callback;
+        return old;
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(
+                AppMessageInboxDropped dropped_callback)
+{
+        AppMessageInboxDropped old = s_inbox_dropped;
+        s_inbox_dropped = dropped_callback;
+        return old;
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(
+                AppMessageOutboxSent sent_callback)
+{
+        AppMessageOutboxSent old = s_outbox_sent;
+        s_outbox_sent = sent_callback;
+        return old;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(
+                AppMessageOutboxFailed failed_callback)
+{
+        AppMessageOutboxFailed old = s_outbox_failed;
+        s_outbox_failed = failed_callback;
+        return old;
+}
+
+// background worker: with -w, worker_src is installed.  It runs beside
+// the face on a stack of its own; its worker_event_loop() hands back to the
+// host, whose loop delivers its messages as it does everything else.  The
+// face and the worker share persistent storage, as on the watch.
+
+static void worker_switch(void)
+{
+        s_in_worker = true;
+        swapcontext(&s_host_context, &s_worker_context);
+        s_in_worker = false;
+}
+
+static void worker_entry(void)
+{
+        worker_main();
+        s_worker_running = false;
+}
+
+void worker_event_loop(void)
+{
+        swapcontext(&s_worker_context, &s_host_context);
+}
+
+// back into the worker, so its event loop returns and it deinits
+static void worker_stop(void)
+{
+        if ( s_worker_running )
+                worker_switch();
+        free(s_worker_stack);
+        s_worker_stack = NULL;
+}
+
+bool app_worker_is_running(void)
+{
+        return s_worker_running;
+}
+
+AppWorkerResult app_worker_launch(void)
+{
+        if ( !host_options.worker )
+                return APP_WORKER_RESULT_NO_WORKER;
+        if ( s_worker_running )
+                return APP_WORKER_RESULT_ALREADY_RUNNING;
+
+        s_worker_stack = malloc(HOST_WORKER_STACK);
+        getcontext(&s_worker_context);
+        s_worker_context.uc_stack.ss_sp = s_worker_stack;
+        s_worker_context.uc_stack.ss_size = HOST_WORKER_STACK;
+        s_worker_context.uc_link = &s_host_context;
+        makecontext(&s_worker_context, worker_entry, 0);
+
+        // its init runs now, up to worker_event_loop()
+        s_worker_running = true;
+        worker_switch();
+        return APP_WORKER_RESULT_SUCCESS;
+}
+
+bool app_worker_message_subscribe(AppWorkerMessageHandler handler)
+{
+        if ( s_in_worker )
+                s_worker_handler = handler;
+        else
+                s_face_worker_handler = handler;
+        return true;
+}
+
+bool app_worker_message_unsubscribe(void)
+{
+        return app_worker_message_subscribe(NULL);
+}
+
+static void worker_message_arrive(void *data)
+{
+        HostWorkerMessage *message = data;
+
+        if ( host_options.verbose )
+                fprintf(stderr, "[%lld] host: %s message %u\n",
+                        (long long)s_now_ms, message->to_worker ?
+                        "face -> worker" : "worker -> face", message->type);
+
+        if ( message->to_worker && s_worker_running && s_worker_handler ) {
+                s_in_worker = true;
+                s_worker_handler(message->type, &message->data);
+                s_in_worker = false;
+        } else if ( !message->to_worker && s_face_worker_handler ) {
+                s_face_worker_handler(message->type, &message->data);
+        }
+        free(message);
+}
+
+// to the other side, if it is there to hear it when the message arrives
+void app_worker_send_message(uint8_t type, AppWorkerMessage *data)
+{
+        HostWorkerMessage *message = malloc(sizeof(HostWorkerMessage));
+        message->to_worker = !s_in_worker;
+        message->type = type;
+        message->data = *data;
+        host_day.worker_msgs++;
+        host_schedule(0, worker_message_arrive, message);
+}
+
+// battery: full at the start and down drain_pct_per_day a day from there,
+// in the watch's 10% steps; it isn't charged from what the face does
+
+BatteryChargeState battery_state_service_peek(void)
+{
+        int64_t elapsed_ms = s_now_ms - (int64_t)host_options.start * 1000;
+        int64_t drained = elapsed_ms * host_options.drain_pct_per_day
+                          / 86400000;
+        int percent = drained >= 100 ? 0 : 100 - (int)drained;
+
+        return (BatteryChargeState) {
+                .charge_percent = (uint8_t)((percent + 9) / 10 * 10),
+        };
+}
+
+void battery_state_service_subscribe(BatteryStateHandler handler)
+{
+        s_battery_handler = handler;
+        s_battery_told = battery_state_service_peek().charge_percent;
+}
+
+void battery_state_service_unsubscribe(void)
+{
+        s_battery_handler = NULL;
+}
+
+bool quiet_time_is_active(void)
+{
+        time_t now = (time_t)(s_now_ms / 1000);
+        struct tm *local = localtime(&now);
+
+        return host_options.quiet_nights
+                && (local->tm_hour >= 22 || local->tm_hour < 7);
+}
+
+// event loop: fast-forward the virtual clock, firing minute ticks, timers
+// and message deliveries in time order, one render pass after each
+
+static void report_header(void)
+{
+        printf("%4s %6s %7s %8s %7s %9s %8s %7s %7s %6s %8s %6s %6s %5s "
+               "%5s %4s %8s %4s %7s\n",
+               "day", "ticks", "renders", "layers", "draws", "dirty_px",
+               "set_text",
+               "dirty", "timers", "bmaps", "bmap_kb", "p_rd", "p_wr",
+               "out", "in", "drop", "in_bytes", "wmsg", "heap_hi");
+}
+
+static void report_row(const char *label, const HostCounters *c)
+{
+        printf("%4s %6u %7u %8u %7u %9u %8u %7u %7u %6u %8.1f %6u %6u %5u "
+               "%5u %4u %8u %4u %7u\n",
+               label, c->ticks, c->render_passes, c->layers_drawn,
+               c->draw_calls, c->dirty_px, c->set_text, c->mark_dirty, c->timers_fired,
+               c->bitmaps_created, c->bitmap_bytes / 1024.0,
+               c->persist_reads, c->persist_writes, c->outbox_sent,
+               c->inbox_received, c->inbox_dropped, c->inbox_bytes,
+               c->worker_msgs, c->heap_peak);
+}
+
+static void report_day(int day)
+{
+        char label[8];
+        snprintf(label, sizeof(label), "%d", day);
+        report_row(label, &host_day);
+
+        // every counter sums across days except the heap high-water mark
+        uint32_t heap_peak = host_total.heap_peak;
+        uint32_t *total = (uint32_t *)&host_total;
+        uint32_t *today = (uint32_t *)&host_day;
+        for ( size_t i = 0; i < sizeof(HostCounters) / sizeof(uint32_t); i++ )
+                total[i] += today[i];
+        host_total.heap_peak = host_day.heap_peak > heap_peak ?
+                                host_day.heap_peak : heap_peak;
+
+        memset(&host_day, 0, sizeof(host_day));
+        host_day.heap_peak = s_heap_used;
+}
+
+static struct AppTimer *next_event(void)
+{
+        struct AppTimer *next = NULL;
+        for ( int i = 0; i < HOST_MAX_EVENTS; i++ )
+                if ( s_events[i].active
+                     && (!next || s_events[i].at_ms < next->at_ms) )
+                        next = &s_events[i];
+        return next;
+}
+
+static void fire_tick(void)
+{
+        time_t now = (time_t)(s_now_ms / 1000);
+        struct tm *tick_time = localtime(&now);
+        TimeUnits changed = SECOND_UNIT | MINUTE_UNIT;
+        if ( tick_time->tm_min == 0 )
+                changed |= HOUR_UNIT;
+        if ( tick_time->tm_min == 0 && tick_time->tm_hour == 0 )
+                changed |= DAY_UNIT;
+
+        host_day.ticks++;
+
+        // the watch tells apps as the battery passes each step
+        BatteryChargeState charge = battery_state_service_peek();
+        if ( s_battery_handler && charge.charge_percent != s_battery_told ) {
+                s_battery_told = charge.charge_percent;
+                s_battery_handler(charge);
+        }
+
+        if ( s_tick_handler && (changed & s_tick_units) )
+                s_tick_handler(tick_time, changed);
+}
+
+// runs until until_ms, reporting each day as it passes
+static void host_loop(int64_t until_ms)
+{
+        for ( ;; ) {
+                struct AppTimer *event = next_event();
+                int64_t at_ms = s_next_tick_ms;
+                if ( event && event->at_ms < at_ms )
+                        at_ms = event->at_ms;
+                else
+                        event = NULL;
+
+                int64_t reached_ms = at_ms < until_ms ? at_ms : until_ms;
+                while ( reached_ms >= s_day_end_ms && s_day_end_ms <= s_end_ms ) {
+                        report_day(s_day++);
+                        s_day_end_ms += 86400000;
+                }
+                if ( at_ms >= until_ms )
+                        break;
+
+                s_now_ms = at_ms;
+                if ( event ) {
+                        event->active = false;
+                        if ( event->is_app_timer )
+                                host_day.timers_fired++;
+                        event->handler(event->data);
+                } else {
+                        fire_tick();
+                        s_next_tick_ms += 60000;
+                }
+                render();
+        }
+        s_now_ms = until_ms;
+}
+
+// the face's session: until it is closed with -c, or the run ends
+void app_event_loop(void)
+{
+        int64_t until_ms = s_end_ms;
+        if ( host_options.close_every_h > 0
+             && s_now_ms + host_options.close_every_h * 3600000LL < until_ms )
+                until_ms = s_now_ms + host_options.close_every_h * 3600000LL;
+
+        render();
+        phone_on_ready();
+        host_loop(until_ms);
+}
+
+// what the watch takes back from an app that has exited: its services,
+// its AppMessage buffers, and timers and sends still pending
+static void host_close_face(void)
+{
+        s_top_window = NULL;
+        s_tick_handler = NULL;
+        s_battery_handler = NULL;
+        s_face_worker_handler = NULL;
+        s_inbox_received = NULL;
+        s_inbox_dropped = NULL;
+        s_outbox_sent = NULL;
+        s_outbox_failed = NULL;
+
+        // the worker sets no timers, so every app timer is the face's
+        for ( int i = 0; i < HOST_MAX_EVENTS; i++ )
+                if ( s_events[i].is_app_timer
+                     || s_events[i].handler == outbox_complete )
+                        s_events[i].active = false;
+
+        if ( s_inbox_buffer )
+                host_free(s_inbox_buffer);
+        if ( s_outbox_buffer )
+                host_free(s_outbox_buffer);
+        s_inbox_buffer = NULL;
+        s_outbox_buffer = NULL;
+        s_outbox_busy = false;
+}
+
+// The face is loaded afresh for each session, so its statics start from
+// zero each time it opens, as they do on the watch.  Between sessions the
+// virtual clock runs on with only the phone and the worker.
+void host_run(void)
+{
+        for ( ;; ) {
+                void *face = dlopen(host_options.face_library,
+                                    RTLD_NOW | RTLD_LOCAL);
+                if ( !face ) {
+                        fprintf(stderr, "host: %s\n", dlerror());
+                        exit(1);
+                }
+                int (*face_main)(void) = (int (*)(void))dlsym(face,
+                                                              "pebble_main");
+                if ( !face_main ) {
+                        fprintf(stderr, "host: %s\n", dlerror());
+                        exit(1);
+                }
+
+                face_main();
+                host_close_face();
+                dlclose(face);
+
+                if ( s_now_ms >= s_end_ms )
+                        break;
+                if ( host_options.verbose )
+                        fprintf(stderr, "[%lld] host: face closed\n",
+                                (long long)s_now_ms);
+                host_loop(s_now_ms + HOST_CLOSED_MS < s_end_ms ?
+                          s_now_ms + HOST_CLOSED_MS : s_end_ms);
+                if ( s_now_ms >= s_end_ms )
+                        break;
+        }
+
+        worker_stop();
+        printf("\n");
+        report_row("all", &host_total);
+}
+
+void host_start(void)
+{
+        s_now_ms = (int64_t)host_options.start * 1000;
+        s_end_ms = s_now_ms + (int64_t)host_options.days * 86400000;
+        s_next_tick_ms = (s_now_ms / 60000 + 1) * 60000;
+        s_day_end_ms = s_now_ms + 86400000;
+        report_header();
+}
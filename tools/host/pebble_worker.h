@@ -0,0 +1,9 @@
+#pragma once
+
+// Host stand-in for the worker SDK header.  A worker sees the same stubs as
+// the face; pebble_host.c runs it beside the face as a coroutine, and its
+// event loop is the host's.
+
+#include <pebble.h>
+
+void worker_event_loop(void);
@@ -0,0 +1,426 @@
+#include <math.h>
+
+#include "host.h"
+#include "messages.auto.h"
+
+// Stand-in for pebble-js-app.js: each refresh runs the providers with
+// simulated latencies, merges their fields into one batch and sends it as a
+// single AppMessage once the last one answers.  Messages carry a seq and are
+// resent with backoff until the watch acks it, like sendData() in the js.
+// The tide table is only fetched when the watch asks for it, and a recent
+// location fix is reused.  A refresh asked for while one is running joins
+// it, or runs once it's done if it wants tides the running one doesn't.
+// While it has data it sends the offline forecast every few hours, each
+// point in a message of its own.
+
+// simulated latencies; everything but the switches waits for the fix
+#define GPS_FIX_MS              1500
+#define POSITION_MAX_AGE_S      (20 * 60)
+#define FORECAST_MS             900
+#define WEATHER_MS              1100
+#define TIDE_STATION_MS         700
+#define TIDE_MS                 900
+
+// delivery, as in the js
+#define QUEUE_LIMIT             4
+#define ACK_TIMEOUT_MS          5000
+#define RETRY_BASE_MS           1000
+#define RETRY_MAX_MS            30000
+#define SEND_ATTEMPTS           6
+
+#define TIDE_PERIOD_S           44712   // 12h 25m 12s
+#define TIDE_MEAN_CM            107
+#define TIDE_RANGE_CM           91
+#define TIDE_BACK_S             (12 * 60 * 60)
+
+#define POWER_PCT               { 50, 30, 20, 10 }      // as the js defaults
+
+// the offline forecast: here and one waypoint, as often as the js sends it
+#define PACK_EVERY_S            (6 * 60 * 60)
+#define PACK_HOURS              24
+#define WAYPOINT_LAT_E5         4137000
+#define WAYPOINT_LON_E5         -7080000
+
+// a message with every field unknown and nothing flagged present
+static WeatherMessage weather_begin(void)
+{
+        WeatherMessage weather;
+        memset(&weather, 0xff, sizeof(weather));
+        weather.present = 0;
+        weather.temp = weather.temp_hilo = UNKNOWN_INT8;
+        weather.lat_e5 = weather.lon_e5 = UNKNOWN_INT32;
+        memset(weather.city, 0, sizeof(weather.city));
+        return weather;
+}
+
+static WeatherMessage s_batch;
+static TidesMessage s_batch_tides;
+static bool s_batch_has_tides;
+static bool s_batch_wants_tides;
+static bool s_refresh_again;
+static int s_pending;
+
+typedef struct Outgoing {
+        WeatherMessage weather;
+        TidesMessage tides;
+        PackMessage pack;
+        bool has_tides;
+        bool is_pack;
+        uint16_t seq;
+        int attempts;
+} Outgoing;
+
+static Outgoing s_queue[QUEUE_LIMIT];
+static int s_queued;
+static uint16_t s_seq;
+static time_t s_packs_sent;
+static bool s_in_flight;        // head sent, or waiting to be resent
+// host_schedule can't cancel, so stale timeouts compare against this
+static uintptr_t s_timer_token;
+
+static void ack_timeout(void *data);
+static void refresh(bool tides);
+static bool offline(void);
+static void send_packs(void);
+
+static void send_next(void *data)
+{
+        if ( s_in_flight || s_queued == 0 )
+                return;
+
+        uint8_t buffer[APP_MESSAGE_IN_SIZE];
+        DictionaryIterator iter;
+        dict_write_begin(&iter, buffer, sizeof(buffer));
+        dict_write_int32(&iter, KEY_SEQ, s_queue[0].seq);
+        if ( s_queue[0].is_pack )
+                dict_write_data(&iter, KEY_PACK,
+                                (const uint8_t *)&s_queue[0].pack,
+                                sizeof(s_queue[0].pack));
+        else
+                dict_write_data(&iter, KEY_WEATHER,
+                        (const uint8_t *)&s_queue[0].weather,
+                        sizeof(s_queue[0].weather));
+        if ( !s_queue[0].is_pack && s_queue[0].has_tides )
+                dict_write_data(&iter, KEY_TIDES,
+                                (const uint8_t *)&s_queue[0].tides,
+                                sizeof(s_queue[0].tides));
+        host_deliver_inbox(0, buffer, (uint16_t)dict_write_end(&iter));
+
+        s_in_flight = true;
+        host_schedule(ACK_TIMEOUT_MS, ack_timeout, (void *)++s_timer_token);
+}
+
+static void dequeue(void)
+{
+        s_in_flight = false;
+        s_timer_token++;
+        memmove(&s_queue[0], &s_queue[1], --s_queued * sizeof(s_queue[0]));
+        send_next(NULL);
+}
+
+static void resend(void *data)
+{
+        if ( (uintptr_t)data != s_timer_token || !s_in_flight )
+                return;
+        s_in_flight = false;
+        send_next(NULL);
+}
+
+static void ack_timeout(void *data)
+{
+        if ( (uintptr_t)data != s_timer_token || !s_in_flight )
+                return;
+
+        if ( ++s_queue[0].attempts >= SEND_ATTEMPTS ) {
+                dequeue();
+                return;
+        }
+
+        uint32_t delay = RETRY_BASE_MS << (s_queue[0].attempts - 1);
+        host_schedule(delay < RETRY_MAX_MS ? delay : RETRY_MAX_MS, resend,
+                      (void *)++s_timer_token);
+}
+
+static void send(const WeatherMessage *weather, const TidesMessage *tides)
+{
+        // Every message here is a whole refresh, so when the queue is full
+        // the newest waiting one can simply be replaced.  With only packs
+        // waiting, the oldest of them makes room.  The head may be in
+        // flight, so it stays.
+        Outgoing *entry = NULL;
+
+        if ( s_queued >= QUEUE_LIMIT ) {
+                for ( int i = s_queued - 1; i >= 1 && !entry; i-- )
+                        if ( !s_queue[i].is_pack )
+                                entry = &s_queue[i];
+                if ( !entry ) {
+                        memmove(&s_queue[1], &s_queue[2],
+                                (s_queued - 2) * sizeof(s_queue[0]));
+                        s_queued--;
+                        s_packs_sent = 0;       // again next refresh
+                }
+        }
+        if ( !entry )
+                entry = &s_queue[s_queued++];
+        entry->is_pack = false;
+        entry->weather = *weather;
+        entry->has_tides = tides != NULL;
+        if ( tides )
+                entry->tides = *tides;
+        entry->seq = s_seq = s_seq % 0xffff + 1;
+        entry->attempts = 0;
+        send_next(NULL);
+}
+
+// false when the queue is full; the packs go again next refresh
+static bool send_pack(const PackMessage *pack)
+{
+        if ( s_queued == ARRAY_LENGTH(s_queue) )
+                return false;
+
+        Outgoing *entry = &s_queue[s_queued++];
+        entry->is_pack = true;
+        entry->has_tides = false;
+        entry->pack = *pack;
+        entry->seq = s_seq = s_seq % 0xffff + 1;
+        entry->attempts = 0;
+        send_next(NULL);
+        return true;
+}
+
+static void on_ack(uint16_t seq)
+{
+        if ( s_in_flight && s_queued > 0 && s_queue[0].seq == seq )
+                dequeue();
+}
+
+static void batch_done(const WeatherMessage *weather)
+{
+        s_batch = *weather;
+        if ( --s_pending > 0 )
+                return;
+
+        send(&s_batch, s_batch_has_tides ? &s_batch_tides : NULL);
+        if ( !offline() )
+                send_packs();
+        if ( s_refresh_again ) {
+                s_refresh_again = false;
+                refresh(true);
+        }
+}
+
+static bool offline(void)
+{
+        return host_options.offline_after_h > 0
+                && time(NULL) - host_options.start
+                   >= host_options.offline_after_h * 60 * 60;
+}
+
+static uint16_t wind_dkt_at(time_t t)
+{
+        int hour = localtime(&t)->tm_hour;
+        return (uint16_t)lround((6 + (hour * 7) % 13) * 8.68976);
+}
+
+static uint16_t wind_deg_at(time_t t)
+{
+        return (uint16_t)((t / 5400) % 16 * 225 / 10);
+}
+
+static int8_t temp_at(time_t t)
+{
+        int hour = localtime(&t)->tm_hour;
+        return 64 + 10 * (hour > 6 && hour < 18);
+}
+
+// the coming PACK_HOURS for here and the waypoint
+static void send_packs(void)
+{
+        time_t now = time(NULL);
+        const int32_t points[][2] = {
+                { 4152345, -7067123 },
+                { WAYPOINT_LAT_E5, WAYPOINT_LON_E5 },
+        };
+
+        if ( s_packs_sent && now - s_packs_sent < PACK_EVERY_S )
+                return;
+        s_packs_sent = now;
+
+        for ( unsigned i = 0; i < ARRAY_LENGTH(points); i++ ) {
+                PackMessage pack;
+                memset(&pack, 0, sizeof(pack));
+                pack.start = (uint32_t)(now / 3600 * 3600);
+                pack.point = (uint8_t)i;
+                pack.count = PACK_HOURS;
+                pack.lat_e5 = points[i][0];
+                pack.lon_e5 = points[i][1];
+                for ( int h = 0; h < PACK_HOURS; h++ ) {
+                        time_t t = (time_t)pack.start + h * 3600;
+                        pack.wind_dkt[h] = wind_dkt_at(t);
+                        pack.wind_deg[h] = wind_deg_at(t);
+                        pack.temp[h] = temp_at(t);
+                        pack.forecast[h] = FORECAST_CLEAR;
+                }
+                if ( !send_pack(&pack) )
+                        s_packs_sent = 0;
+        }
+}
+
+static int16_t tide_height(time_t t)
+{
+        return (int16_t)lround(TIDE_MEAN_CM + TIDE_RANGE_CM
+                 * cos(2 * M_PI * (double)(t % TIDE_PERIOD_S) / TIDE_PERIOD_S));
+}
+
+static int8_t current_temp(void)
+{
+        return temp_at(time(NULL));
+}
+
+static void add_nothing(void *data)
+{
+        batch_done(&s_batch);
+}
+
+static void add_switches(void *data)
+{
+        WeatherMessage weather = s_batch;
+        weather.present |= PRESENT_FLAGS;
+        weather.flags = 0;
+        memcpy(weather.power_pct, (uint8_t[])POWER_PCT,
+               sizeof(weather.power_pct));
+        batch_done(&weather);
+}
+
+static void add_location(void *data)
+{
+        WeatherMessage weather = s_batch;
+        weather.present |= PRESENT_COORDS;
+        weather.lat_e5 = 4152345;
+        weather.lon_e5 = -7067123;
+        batch_done(&weather);
+}
+
+static void add_sunrise_sunset(void *data)
+{
+        WeatherMessage weather = s_batch;
+        weather.present |= PRESENT_SUN;
+        weather.sunrise_min = 6 * 60 + 4;
+        weather.sunset_min = 19 * 60 + 21;
+        batch_done(&weather);
+}
+
+static void add_forecast(void *data)
+{
+        WeatherMessage weather = s_batch;
+        weather.present |= PRESENT_TEMP | PRESENT_TEMP_HILO | PRESENT_FORECAST;
+        weather.temp = current_temp();
+        weather.temp_hilo = 78;
+        weather.forecast = FORECAST_CLEAR;
+        batch_done(&weather);
+}
+
+static void add_weather(void *data)
+{
+        time_t now = time(NULL);
+
+        WeatherMessage weather = s_batch;
+        weather.present |= PRESENT_TEMP | PRESENT_TEMP_HILO | PRESENT_WIND;
+        weather.temp = current_temp();
+        weather.temp_hilo = 78;
+        weather.wind_dkt = wind_dkt_at(now);
+        weather.wind_deg = wind_deg_at(now);
+        batch_done(&weather);
+}
+
+// highs and lows from half a day back for as many as the table holds
+static void add_tide(void *data)
+{
+        time_t now = time(NULL);
+
+        // extrema fall on multiples of half the period
+        time_t half = TIDE_PERIOD_S / 2;
+        time_t first = (now - TIDE_BACK_S) / half * half + half;
+
+        memset(&s_batch_tides, 0, sizeof(s_batch_tides));
+        s_batch_tides.start = (uint32_t)first;
+        s_batch_tides.count = ARRAY_LENGTH(s_batch_tides.offset_min);
+        for ( int i = 0; i < s_batch_tides.count; i++ ) {
+                s_batch_tides.offset_min[i] = (uint16_t)(i * half / 60);
+                s_batch_tides.height_cm[i] = tide_height(first + i * half);
+        }
+        s_batch_has_tides = true;
+        batch_done(&s_batch);
+}
+
+static void refresh(bool tides)
+{
+        // when each provider answers, counted from the location fix
+        static const struct {
+                uint32_t delay_ms;
+                HostEventHandler add;
+                bool tides;
+                bool network;
+        } providers[] = {
+                { 0, add_location, false, false },
+                { 0, add_sunrise_sunset, false, false },        // no fetch
+                { FORECAST_MS, add_forecast, false, true },
+                { WEATHER_MS, add_weather, false, true },
+                { TIDE_STATION_MS + TIDE_MS, add_tide, true, true },
+        };
+        int count = sizeof(providers) / sizeof(providers[0]);
+        static time_t fixed;
+        time_t now = time(NULL);
+        uint32_t fix_ms = 0;
+
+        if ( s_pending > 0 ) {
+                s_refresh_again |= tides && !s_batch_wants_tides;
+                return;
+        }
+
+        if ( now - fixed >= POSITION_MAX_AGE_S ) {
+                fixed = now;
+                fix_ms = GPS_FIX_MS;
+        }
+
+        s_batch = weather_begin();
+        s_batch_has_tides = false;
+        s_batch_wants_tides = tides;
+        s_pending = 1;
+        for ( int i = 0; i < count; i++ )
+                s_pending += !providers[i].tides || tides;
+
+        host_schedule(0, add_switches, NULL);
+        // with no data the requests fail and add nothing
+        for ( int i = 0; i < count; i++ )
+                if ( !providers[i].tides || tides )
+                        host_schedule(fix_ms + providers[i].delay_ms,
+                                      providers[i].network && offline()
+                                      ? add_nothing : providers[i].add,
+                                      NULL);
+}
+
+// as in the js, the face asks when it wants something
+void phone_on_ready(void)
+{
+}
+
+void phone_on_message(DictionaryIterator *iterator)
+{
+        Tuple *ack = dict_find(iterator, KEY_ACK);
+        Tuple *request = dict_find(iterator, KEY_REFRESH);
+        Tuple *stats = dict_find(iterator, KEY_STATS);
+        if ( stats && stats->length == sizeof(StatsMessage) ) {
+                StatsMessage s;
+                memcpy(&s, stats->value->data, sizeof(s));
+                APP_LOG(APP_LOG_LEVEL_INFO, "stats since %lu: in %u dropped %u "
+                        "failed %u redraws %u frames %u refreshes %u heap %lu",
+                        (unsigned long)s.start, s.msgs_in, s.msgs_dropped,
+                        s.sends_failed, s.redraws, s.prop_frames, s.refreshes,
+                        (unsigned long)s.heap_free_min);
+        }
+        if ( ack )
+                on_ack(ack->value->uint16);
+        if ( request )
+                refresh(request->value->uint8 & REFRESH_TIDES);
+}
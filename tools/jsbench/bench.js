@@ -0,0 +1,441 @@
+#!/usr/bin/env node
+//
+// Runs src/js against recorded provider responses and times whole refreshes,
+// from the watch's request to the last AppMessage being acked:
+//
+//   node tools/jsbench/bench.js [--runs n] [--latency ms] [--jitter ms]
+//       [--fail fraction] [--fix ms] [--watch ms] [--provider noaa|wunderground]
+//       [--seed n] [--budget ms] [--json] [--record] [-v]
+//
+// The js runs in its own context with Pebble, navigator.geolocation,
+// localStorage and XMLHttpRequest stubbed.  Requests go to a local stand-in
+// server that answers from tools/jsbench/fixtures (see routes.json) after
+// --latency ms plus up to --jitter ms, and drops --fail of them.  --record
+// first fetches each response from the real provider and saves it as the
+// fixture.
+//
+// Each run is a sequence of refreshes sharing localStorage:
+//
+//   cold      empty storage, tide table wanted, new location fix
+//   warm      straight after, nothing wanted that isn't cached
+//   hour      an hour later: new fix, expired entries revalidated
+//   relaunch  the same hour in a new context, so only localStorage survives
+//
+// The medians are printed, or with --json written as one object for CI.
+// Exits 1 if a refresh never finishes or the cold median is over --budget.
+//
+
+'use strict';
+
+const fs = require('fs');
+const http = require('http');
+const https = require('https');
+const path = require('path');
+const vm = require('vm');
+
+const ROOT = path.resolve(__dirname, '..', '..');
+const JS_DIR = path.join(ROOT, 'src', 'js');
+const FIXTURES = path.join(__dirname, 'fixtures');
+
+const REFRESH_TIDES = 1;            // REFRESH.tides in messages.json
+const REFRESH_TIMEOUT_MS = 60000;   // past the js's own BATCH_DEADLINE_MS
+const POSITION = {latitude: 41.52345, longitude: -70.67123};
+// the js's clock starts when the fixtures were recorded, so they're current;
+// move it after --record
+const FIXTURE_TIME = Date.parse('2017-08-27T12:00:00Z');
+
+const SCENARIOS = [
+    {name: 'cold', refresh: REFRESH_TIDES, advance_ms: 0, relaunch: false},
+    {name: 'warm', refresh: 0, advance_ms: 0, relaunch: false},
+    {name: 'hour', refresh: 0, advance_ms: 60 * 60 * 1000, relaunch: false},
+    {name: 'relaunch', refresh: 0, advance_ms: 0, relaunch: true},
+];
+
+const COLUMNS = ['ms', 'xhrs', 'not_mod', 'failed', 'bytes_in',
+                 'parses', 'parse_ms', 'msgs', 'msg_bytes'];
+
+function parseArgs(argv){
+    const options = {runs: 5, latency: 150, jitter: 100, fail: 0, fix: 300,
+                     watch: 50, provider: 'noaa', seed: 1, budget: 0,
+                     json: false, record: false, verbose: false};
+    const numbers = ['runs', 'latency', 'jitter', 'fail', 'fix', 'watch',
+                     'seed', 'budget'];
+
+    for (let i = 0; i < argv.length; i++){
+        const arg = argv[i];
+        const name = arg.replace(/^--?/, '');
+        if (arg == '-v'){
+            options.verbose = true;
+        } else if (name == 'json' || name == 'record'){
+            options[name] = true;
+        } else if (numbers.indexOf(name) >= 0 && i + 1 < argv.length){
+            options[name] = parseFloat(argv[++i]);
+        } else if (name == 'provider' && i + 1 < argv.length){
+            options.provider = argv[++i];
+        } else {
+            throw new Error('unknown option ' + arg);
+        }
+    }
+    if (options.provider != 'noaa' && options.provider != 'wunderground'){
+        throw new Error('--provider is noaa or wunderground');
+    }
+    return options;
+}
+
+// mulberry32, so a --seed gives the same jitter and failures every time
+function random(seed){
+    let state = seed >>> 0;
+    return function(){
+        state = (state + 0x6d2b79f5) >>> 0;
+        let t = state;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+function fetchReal(url){
+    return new Promise(function(resolve, reject){
+        const get = url.indexOf('https:') == 0 ? https.get : http.get;
+        get(url, {headers: {'User-Agent': 'dayboat jsbench', 'Accept': 'application/json'}},
+            function(res){
+                let body = '';
+                res.setEncoding('utf8');
+                res.on('data', function(chunk){ body += chunk; });
+                res.on('end', function(){
+                    if (res.statusCode == 200){
+                        resolve(body);
+                    } else {
+                        reject(new Error(url + ': ' + res.statusCode));
+                    }
+                });
+            }).on('error', reject);
+    });
+}
+
+// The stand-in for every provider.  The original url comes in X-Url.
+function startServer(options, rand){
+    const routes = JSON.parse(fs.readFileSync(path.join(FIXTURES, 'routes.json'), 'utf8'))
+            .map(function(route){
+                return {match: new RegExp(route.match), file: route.file,
+                        headers: route.headers, recorded: false};
+            });
+
+    const server = http.createServer(function(req, res){
+        const url = req.headers['x-url'] || '';
+        const route = routes.find(function(r){ return r.match.test(url); });
+        const delay = options.latency + rand() * options.jitter;
+        const failed = rand() < options.fail;
+
+        const answer = function(){
+            if (failed){
+                req.socket.destroy();
+                return;
+            }
+            if (!route){
+                res.writeHead(404);
+                res.end();
+                return;
+            }
+            const etag = route.headers.ETag;
+            if (etag && req.headers['if-none-match'] == etag){
+                res.writeHead(304, route.headers);
+                res.end();
+                return;
+            }
+            const body = route.file ? fs.readFileSync(path.join(FIXTURES, route.file)) : '';
+            res.writeHead(200, Object.assign({'Content-Type': 'application/json'}, route.headers));
+            res.end(body);
+        };
+
+        if (options.record && route && route.file && !route.recorded){
+            route.recorded = true;
+            fetchReal(url).then(function(body){
+                fs.writeFileSync(path.join(FIXTURES, route.file), body);
+                console.error('recorded ' + route.file + ' from ' + url);
+            }, function(err){
+                console.error('not recorded: ' + err.message);
+            }).then(function(){ setTimeout(answer, delay); });
+            return;
+        }
+        setTimeout(answer, delay);
+    });
+
+    return new Promise(function(resolve){
+        server.listen(0, '127.0.0.1', function(){ resolve(server); });
+    });
+}
+
+// What a refresh did; the stubs add to whichever one is current.
+function newStats(){
+    const stats = {};
+    COLUMNS.forEach(function(column){ stats[column] = 0; });
+    return stats;
+}
+
+// One phone: a context with the app loaded, its localStorage and the clock
+// it sees, which runs clock.offset ms ahead of the real one.  The stubs count
+// into meter.stats.
+function loadApp(options, port, store, clock, meter){
+    const listeners = {};
+    const pending = {xhrs: 0, fixes: 0};
+    let idle = null;
+
+    const settle = function(){
+        setImmediate(function(){
+            if (idle && pending.xhrs == 0 && pending.fixes == 0
+                    && context.send_queue.length == 0){
+                const done = idle;
+                idle = null;
+                done();
+            }
+        });
+    };
+
+    class ClockDate extends Date {
+        constructor(...args){
+            if (args.length == 0){
+                super(Date.now() + clock.offset);
+            } else {
+                super(...args);
+            }
+        }
+        static now(){
+            return Date.now() + clock.offset;
+        }
+    }
+
+    function XMLHttpRequest(){
+        this.headers = {};
+        this.status = 0;
+        this.responseText = '';
+        this.response_headers = {};
+    }
+    XMLHttpRequest.prototype.open = function(method, url){
+        this.method = method;
+        this.url = url;
+    };
+    XMLHttpRequest.prototype.setRequestHeader = function(name, value){
+        this.headers[name] = value;
+    };
+    XMLHttpRequest.prototype.getResponseHeader = function(name){
+        const value = this.response_headers[name.toLowerCase()];
+        return value === undefined ? null : value;
+    };
+    XMLHttpRequest.prototype.send = function(){
+        const xhr = this;
+        const headers = Object.assign({'X-Url': xhr.url}, xhr.headers);
+        // the telemetry upload isn't part of a refresh, so it isn't counted
+        const counted = xhr.url.indexOf(vm.runInContext('URL_LOGGING', context)) != 0;
+        const count = counted ? meter.stats : newStats();
+        count.xhrs++;
+        pending.xhrs += counted;
+
+        const finish = function(handler){
+            pending.xhrs -= counted;
+            if (handler){
+                handler.call(xhr);
+            }
+            settle();
+        };
+
+        const req = http.request({host: '127.0.0.1', port: port, method: xhr.method,
+                                  path: '/', headers: headers, agent: false},
+            function(res){
+                let body = '';
+                res.setEncoding('utf8');
+                res.on('data', function(chunk){ body += chunk; });
+                res.on('end', function(){
+                    count.bytes_in += Buffer.byteLength(body);
+                    count.not_mod += res.statusCode == 304;
+                    xhr.status = res.statusCode;
+                    xhr.responseText = body;
+                    xhr.response_headers = res.headers;
+                    finish(xhr.onload);
+                });
+            });
+        xhr.abort = function(){
+            req.destroy();
+        };
+        req.on('error', function(){
+            count.failed++;
+            finish(xhr.onerror);
+        });
+        req.end();
+    };
+
+    const localStorage = {
+        getItem: function(key){ return store.hasOwnProperty(key) ? store[key] : null; },
+        setItem: function(key, value){ store[key] = String(value); },
+        removeItem: function(key){ delete store[key]; },
+    };
+
+    const context = vm.createContext({
+        console: options.verbose ? console : {log: function(){}},
+        setTimeout: setTimeout,
+        clearTimeout: clearTimeout,
+        Date: ClockDate,
+        XMLHttpRequest: XMLHttpRequest,
+        navigator: {geolocation: {getCurrentPosition: function(success){
+            pending.fixes++;
+            setTimeout(function(){
+                pending.fixes--;
+                success({coords: {latitude: POSITION.latitude,
+                                  longitude: POSITION.longitude, accuracy: 10},
+                         timestamp: Date.now() + clock.offset});
+                settle();
+            }, options.fix);
+        }}},
+        Pebble: {
+            addEventListener: function(name, handler){ listeners[name] = handler; },
+            getAccountToken: function(){ return 'bench-account'; },
+            getWatchToken: function(){ return 'bench-watch'; },
+            openURL: function(){},
+            // the watch takes --watch ms to take a message and ack it
+            sendAppMessage: function(message, success){
+                meter.stats.msgs++;
+                Object.keys(message).forEach(function(key){
+                    const value = message[key];
+                    meter.stats.msg_bytes += value instanceof context.Array ? value.length : 4;
+                });
+                setTimeout(function(){
+                    success({});
+                    const payload = {};
+                    payload[vm.runInContext('KEY_ACK', context)] = message[vm.runInContext('KEY_SEQ', context)];
+                    listeners.appmessage({payload: payload});
+                    settle();
+                }, options.watch);
+            },
+        },
+    });
+    context.window = context;
+    context.localStorage = localStorage;
+    context.Array = vm.runInContext('Array', context);
+
+    // JSON.parse is timed; the context's own keeps results in its realm
+    const parse = vm.runInContext('JSON.parse', context);
+    vm.runInContext('JSON', context).parse = function(text, reviver){
+        const start = process.hrtime.bigint();
+        try{
+            return parse(text, reviver);
+        } finally {
+            meter.stats.parses++;
+            meter.stats.parse_ms += Number(process.hrtime.bigint() - start) / 1e6;
+        }
+    };
+
+    fs.readdirSync(JS_DIR).filter(function(name){ return /\.js$/.test(name); }).sort()
+            .forEach(function(name){
+                vm.runInContext(fs.readFileSync(path.join(JS_DIR, name), 'utf8'), context,
+                                {filename: path.join('src', 'js', name)});
+            });
+
+    return {
+        // resolves true once the refresh is over, false if it never is
+        refresh: function(bits){
+            return new Promise(function(resolve){
+                const timer = setTimeout(function(){
+                    idle = null;
+                    resolve(false);
+                }, REFRESH_TIMEOUT_MS);
+                idle = function(){
+                    clearTimeout(timer);
+                    resolve(true);
+                };
+                const payload = {};
+                payload[vm.runInContext('KEY_REFRESH', context)] = bits;
+                listeners.appmessage({payload: payload});
+                settle();
+            });
+        },
+    };
+}
+
+function settings(provider){
+    const store = {};
+    if (provider == 'wunderground'){
+        store.DATA_ALTERNATE = 'true';
+        store.WUNDERGROUND_API_KEY = 'bench';
+    }
+    return store;
+}
+
+async function run(options, port){
+    const store = settings(options.provider);
+    const clock = {offset: FIXTURE_TIME - Date.now()};
+    const meter = {stats: newStats()};
+    let app = loadApp(options, port, store, clock, meter);
+    const results = [];
+
+    for (const scenario of SCENARIOS){
+        clock.offset += scenario.advance_ms;
+        if (scenario.relaunch){
+            app = loadApp(options, port, store, clock, meter);
+        }
+        meter.stats = newStats();
+        const start = process.hrtime.bigint();
+        const done = await app.refresh(scenario.refresh);
+        meter.stats.ms = Number(process.hrtime.bigint() - start) / 1e6;
+        results.push({scenario: scenario.name, done: done, stats: meter.stats});
+    }
+    return results;
+}
+
+function median(values){
+    const sorted = values.slice().sort(function(a, b){ return a - b; });
+    const middle = Math.floor(sorted.length / 2);
+    return sorted.length % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+}
+
+async function main(){
+    const options = parseArgs(process.argv.slice(2));
+    const rand = random(options.seed);
+    const server = await startServer(options, rand);
+    const port = server.address().port;
+    const runs = [];
+
+    for (let i = 0; i < options.runs; i++){
+        runs.push(await run(options, port));
+        options.record = false;
+    }
+    server.close();
+
+    let ok = true;
+    const summary = SCENARIOS.map(function(scenario, i){
+        const row = {scenario: scenario.name,
+                     incomplete: runs.filter(function(r){ return !r[i].done; }).length};
+        COLUMNS.forEach(function(column){
+            row[column] = median(runs.map(function(r){ return r[i].stats[column]; }));
+        });
+        ok = ok && row.incomplete == 0;
+        return row;
+    });
+    if (options.budget > 0 && summary[0].ms > options.budget){
+        ok = false;
+    }
+
+    if (options.json){
+        console.log(JSON.stringify({options: options, scenarios: summary, ok: ok}, null, 2));
+    } else {
+        const header = ['scenario'].concat(COLUMNS, ['incomplete']);
+        console.log(header.map(function(h){ return h.padStart(11); }).join(''));
+        summary.forEach(function(row){
+            console.log(header.map(function(h){
+                const value = row[h];
+                const text = typeof value == 'number' && h.slice(-3) == '_ms' || h == 'ms'
+                        ? value.toFixed(h == 'parse_ms' ? 2 : 0) : String(value);
+                return text.padStart(11);
+            }).join(''));
+        });
+        if (options.budget > 0 && summary[0].ms > options.budget){
+            console.log('cold refresh ' + summary[0].ms.toFixed(0) + 'ms is over the '
+                        + options.budget + 'ms budget');
+        }
+    }
+    process.exit(ok ? 0 : 1);
+}
+
+main().catch(function(err){
+    console.error(err.message);
+    process.exit(2);
+});
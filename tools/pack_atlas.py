@@ -0,0 +1,197 @@
+#!/usr/bin/env python
+#
+# Packs each set of propeller frames, in name order, left to right into one
+# strip:
+#
+#   resources/images/prop[0-9][0-9][0-9].png  -> prop_atlas.png
+#
+# Colours and alpha are rounded to the two bits per channel the watch keeps,
+# which merges the frames' palettes into one small one.  The file is only
+# rewritten when its contents change.  The build runs this; run it by hand
+# after editing a frame.
+#
+#   pack_atlas.py [--check]
+#
+
+import glob
+import os
+import struct
+import sys
+import zlib
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+IMAGES = os.path.join('resources', 'images')
+
+# (frames glob, atlas) under IMAGES
+ATLASES = [
+    ('prop[0-9][0-9][0-9].png', 'prop_atlas.png'),
+]
+
+PNG_SIGNATURE = b'\x89PNG\r\n\x1a\n'
+COLOR_TYPE_PALETTE = 3
+
+
+def read_chunks(data):
+    if data[:8] != PNG_SIGNATURE:
+        raise ValueError('not a png')
+    offset = 8
+    while offset < len(data):
+        length, kind = struct.unpack('>I4s', data[offset:offset + 8])
+        yield kind, data[offset + 8:offset + 8 + length]
+        offset += 12 + length
+
+
+def paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    if pa <= pb and pa <= pc:
+        return a
+    return b if pb <= pc else c
+
+
+def unfilter(raw, stride, height):
+    '''undoes the per-row filters of a byte-per-pixel-or-less image'''
+    rows = []
+    prior = bytearray(stride)
+    offset = 0
+    for _ in range(height):
+        kind = raw[offset]
+        row = bytearray(raw[offset + 1:offset + 1 + stride])
+        offset += 1 + stride
+        for i in range(stride):
+            left = row[i - 1] if i else 0
+            up = prior[i]
+            up_left = prior[i - 1] if i else 0
+            if kind == 1:
+                row[i] = (row[i] + left) & 0xff
+            elif kind == 2:
+                row[i] = (row[i] + up) & 0xff
+            elif kind == 3:
+                row[i] = (row[i] + ((left + up) >> 1)) & 0xff
+            elif kind == 4:
+                row[i] = (row[i] + paeth(left, up, up_left)) & 0xff
+        rows.append(row)
+        prior = row
+    return rows
+
+
+def read_png(path):
+    '''returns width, height and rows of (r, g, b, a) pixels'''
+    with open(path, 'rb') as f:
+        chunks = list(read_chunks(f.read()))
+
+    header = dict(chunks)[b'IHDR']
+    width, height, depth, color_type, _, _, interlace = struct.unpack(
+        '>IIBBBBB', header)
+    if color_type != COLOR_TYPE_PALETTE or interlace:
+        raise ValueError('{}: only non-interlaced palette pngs'.format(path))
+
+    plte = dict(chunks)[b'PLTE']
+    trns = dict(chunks).get(b'tRNS', b'')
+    palette = []
+    for index in range(len(plte) // 3):
+        alpha = trns[index] if index < len(trns) else 255
+        palette.append(tuple(bytearray(plte[index * 3:index * 3 + 3]))
+                       + (alpha,))
+
+    raw = zlib.decompress(b''.join(data for kind, data in chunks
+                                   if kind == b'IDAT'))
+    stride = (width * depth + 7) // 8
+    per_byte = 8 // depth
+    pixels = []
+    for row in unfilter(bytearray(raw), stride, height):
+        line = []
+        for x in range(width):
+            shift = 8 - depth * (x % per_byte + 1)
+            line.append(palette[(row[x // per_byte] >> shift)
+                                & ((1 << depth) - 1)])
+        pixels.append(line)
+    return width, height, pixels
+
+
+def quantize(pixel):
+    '''rounds to two bits per channel, as GColor8 stores it'''
+    r, g, b, a = [(value + 42) // 85 * 85 for value in pixel]
+    if a == 0:
+        return (0, 0, 0, 0)
+    return (r, g, b, a)
+
+
+def write_chunk(kind, data):
+    return (struct.pack('>I', len(data)) + kind + data
+            + struct.pack('>I', zlib.crc32(kind + data) & 0xffffffff))
+
+
+def write_png(width, height, pixels):
+    '''encodes rgba rows as the smallest palette png that holds them'''
+    colours = sorted(set(pixel for row in pixels for pixel in row))
+    depth = next(bits for bits in (1, 2, 4, 8) if len(colours) <= 1 << bits)
+    index = dict((colour, i) for i, colour in enumerate(colours))
+
+    per_byte = 8 // depth
+    raw = bytearray()
+    for row in pixels:
+        packed = bytearray((width * depth + 7) // 8)
+        for x, pixel in enumerate(row):
+            shift = 8 - depth * (x % per_byte + 1)
+            packed[x // per_byte] |= index[pixel] << shift
+        raw += b'\x00' + packed
+
+    plte = b''.join(struct.pack('BBB', *colour[:3]) for colour in colours)
+    trns = b''.join(struct.pack('B', colour[3]) for colour in colours)
+    return (PNG_SIGNATURE
+            + write_chunk(b'IHDR', struct.pack('>IIBBBBB', width, height,
+                                               depth, COLOR_TYPE_PALETTE,
+                                               0, 0, 0))
+            + write_chunk(b'PLTE', plte)
+            + write_chunk(b'tRNS', trns)
+            + write_chunk(b'IDAT', zlib.compress(bytes(raw), 9))
+            + write_chunk(b'IEND', b''))
+
+
+def pack(paths):
+    frames = [read_png(path) for path in paths]
+    width, height = frames[0][0], frames[0][1]
+    for path, frame in zip(paths, frames):
+        if frame[:2] != (width, height):
+            raise ValueError('{}: frames must all be {}x{}'.format(
+                path, width, height))
+
+    pixels = []
+    for y in range(height):
+        pixels.append([quantize(pixel) for frame in frames
+                       for pixel in frame[2][y]])
+    return write_png(width * len(frames), height, pixels)
+
+
+def generate(root=ROOT, check=False):
+    '''returns the list of files that were (or, with check, would be)
+    rewritten'''
+    stale = []
+    for frames, atlas in ATLASES:
+        paths = sorted(glob.glob(os.path.join(root, IMAGES, frames)))
+        if not paths:
+            continue
+
+        atlas = os.path.join(root, IMAGES, atlas)
+        contents = pack(paths)
+        current = None
+        if os.path.exists(atlas):
+            with open(atlas, 'rb') as f:
+                current = f.read()
+        if current != contents:
+            stale.append(atlas)
+            if not check:
+                with open(atlas, 'wb') as f:
+                    f.write(contents)
+    return stale
+
+
+if __name__ == '__main__':
+    check = '--check' in sys.argv[1:]
+    stale = generate(check=check)
+    for path in stale:
+        print('{} {}'.format('stale' if check else 'wrote',
+                             os.path.relpath(path, ROOT)))
+    sys.exit(1 if check and stale else 0)
@@ -0,0 +1,183 @@
+#!/usr/bin/env python
+#
+# Generates everything that depends on platforms.json:
+#
+#   src/platform.auto.h      display size, heap budget and bitmap sizes, in a
+#                            block per platform
+#   appinfo.json             the media list, each bitmap once per memory
+#                            format: 1Bit on black and white, the smallest
+#                            palette on colour
+#
+# and reports what each platform needs from its heap for message buffers
+# and decoded bitmaps, against its budget.  Files are only rewritten when
+# their contents change.  The build runs this and stops when a platform is
+# over budget; run it by hand after editing platforms.json or a bitmap.
+#
+#   platforms.py [--check] [--report]
+#
+
+import json
+import os
+import re
+import struct
+import sys
+
+import schema
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+RESOURCES = 'resources'
+
+FORMAT_BW = '1Bit'
+FORMAT_COLOUR = 'SmallestPalette'
+
+
+def load(root):
+    with open(os.path.join(root, 'platforms.json')) as f:
+        return json.load(f)
+
+
+def memory_format(platform):
+    return FORMAT_COLOUR if platform['colour'] else FORMAT_BW
+
+
+def png_size(path):
+    '''width, height and bits per pixel from the header'''
+    with open(path, 'rb') as f:
+        header = f.read(26)
+    width, height, depth = struct.unpack('>IIB', header[16:25])
+    return width, height, depth
+
+
+def decoded_bytes(root, bitmap, platform):
+    '''as the firmware holds it: word-aligned rows at one bit, or packed
+    rows and a palette'''
+    width, height, depth = png_size(os.path.join(root, RESOURCES,
+                                                 bitmap['file']))
+    if not platform['colour']:
+        return (width + 31) // 32 * 4 * height
+    bits = 8 if depth > 4 else depth
+    return (width * bits + 7) // 8 * height + (1 << bits)
+
+
+def budget(root, config, name):
+    '''what the platform's heap holds at most, by part, and the bytes of
+    resources it installs'''
+    platform = config['platforms'][name]
+    messages = schema.load(root)
+    inbox = schema.buffer_size(messages, 'watch')[0]
+    outbox = schema.buffer_size(messages, 'phone')[0]
+    resident = sum(decoded_bytes(root, bitmap, platform)
+                   for bitmap in config['bitmaps'] if bitmap['resident'])
+    peak = sum(decoded_bytes(root, bitmap, platform)
+               for bitmap in config['bitmaps'])
+    flash = sum(os.path.getsize(os.path.join(root, RESOURCES, bitmap['file']))
+                for bitmap in config['bitmaps'])
+    return {'messages': inbox + outbox, 'bitmaps': resident,
+            'bitmaps_peak': peak, 'heap': inbox + outbox + peak,
+            'budget': platform['heap_budget'], 'resources': flash}
+
+
+def report(root=ROOT, platforms=None):
+    '''one line per platform, and the names of those over budget'''
+    config = load(root)
+    lines = []
+    over = []
+    for name in platforms or sorted(config['platforms']):
+        sizes = budget(root, config, name)
+        lines.append('{}: heap {heap} of {budget} bytes (messages {messages}, '
+                     'bitmaps {bitmaps}, {bitmaps_peak} spinning), '
+                     'resources {resources} bytes'.format(name, **sizes))
+        if sizes['heap'] > sizes['budget']:
+            over.append(name)
+    return lines, over
+
+
+def render_c(root, config):
+    out = ['#pragma once', '',
+           '// generated by tools/platforms.py from platforms.json; do not edit',
+           '']
+    first = True
+    for name in sorted(config['platforms']):
+        platform = config['platforms'][name]
+        sizes = budget(root, config, name)
+        out.append('#{} defined(PBL_PLATFORM_{})'.format(
+            'if' if first else 'elif', name.upper()))
+        first = False
+        for label, value in (('DISPLAY_W', platform['display'][0]),
+                             ('DISPLAY_H', platform['display'][1]),
+                             ('HEAP_BUDGET', sizes['budget']),
+                             ('BITMAP_BYTES', sizes['bitmaps']),
+                             ('BITMAP_BYTES_PEAK', sizes['bitmaps_peak'])):
+            out.append('#define {:<31} {}'.format(label, value))
+    out.append('#else')
+    out.append('#error "no entry in platforms.json for this platform"')
+    out.append('#endif')
+    out.append('')
+    return '\n'.join(out)
+
+
+def patch_appinfo(text, config):
+    entries = []
+    for bitmap in config['bitmaps']:
+        formats = {}
+        for name in sorted(config['platforms']):
+            formats.setdefault(memory_format(config['platforms'][name]),
+                               []).append(name)
+        for format in (FORMAT_BW, FORMAT_COLOUR):
+            if format not in formats:
+                continue
+            entries.append('\n'.join([
+                '      {',
+                '        "type": "bitmap",',
+                '        "name": "{}",'.format(bitmap['name']),
+                '        "file": "{}",'.format(bitmap['file']),
+                '        "memoryFormat": "{}",'.format(format),
+                '        "targetPlatforms": [{}]'.format(', '.join(
+                    '"{}"'.format(name) for name in formats[format])),
+                '      }']))
+    block = '"media": [\n' + ',\n'.join(entries) + '\n    ]'
+    return re.sub(r'"media":\s*\[.*?\n    \]', lambda m: block, text,
+                  count=1, flags=re.S)
+
+
+def outputs(root, config):
+    '''yields (path, new contents) for every generated file'''
+    yield (os.path.join(root, 'src', 'platform.auto.h'),
+           render_c(root, config))
+
+    path = os.path.join(root, 'appinfo.json')
+    with open(path) as f:
+        yield path, patch_appinfo(f.read(), config)
+
+
+def generate(root=ROOT, check=False):
+    '''returns the list of files that were (or, with check, would be)
+    rewritten'''
+    config = load(root)
+    stale = []
+    for path, contents in outputs(root, config):
+        current = None
+        if os.path.exists(path):
+            with open(path) as f:
+                current = f.read()
+        if current != contents:
+            stale.append(path)
+            if not check:
+                with open(path, 'w') as f:
+                    f.write(contents)
+    return stale
+
+
+if __name__ == '__main__':
+    check = '--check' in sys.argv[1:]
+    stale = generate(check=check)
+    for path in stale:
+        print('{} {}'.format('stale' if check else 'wrote',
+                             os.path.relpath(path, ROOT)))
+    over = []
+    if '--report' in sys.argv[1:]:
+        lines, over = report()
+        for line in lines:
+            print(line)
+    sys.exit(1 if (check and stale) or over else 0)
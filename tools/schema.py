@@ -0,0 +1,255 @@
+#!/usr/bin/env python
+#
+# Generates everything that depends on messages.json:
+#
+#   src/messages.auto.h      keys, payload structs, enums and buffer sizes
+#   appinfo.json             the appKeys block
+#   src/js/pebble-js-app.js  the block between the GENERATED markers
+#
+# Files are only rewritten when their contents change.  The build runs this;
+# run it by hand after editing messages.json.
+#
+#   schema.py [--check]
+#
+
+import json
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# byte width and signedness of each field type
+TYPES = {
+    'uint8': (1, False),
+    'uint16': (2, False),
+    'uint32': (4, False),
+    'int8': (1, True),
+    'int16': (2, True),
+    'int32': (4, True),
+    'char': (1, False),
+}
+
+# dictionary header is the tuple count; each tuple has key, type and length
+DICT_HEADER_SIZE = 1
+TUPLE_HEADER_SIZE = 7
+
+JS_BEGIN = '// BEGIN GENERATED by tools/schema.py from messages.json; do not edit'
+JS_END = '// END GENERATED'
+
+
+def load(root):
+    with open(os.path.join(root, 'messages.json')) as f:
+        return json.load(f)
+
+
+def layout(struct):
+    '''returns [(name, type, offset, count, group)] and the packed size'''
+    fields = []
+    offset = 0
+    for field in struct['fields']:
+        count = field.get('count', 1)
+        fields.append((field['name'], field['type'], offset, count,
+                       field.get('group')))
+        offset += TYPES[field['type']][0] * count
+    return fields, offset
+
+
+def tuple_size(schema, key_type):
+    if key_type in TYPES:
+        return TYPES[key_type][0]
+    return layout(schema['structs'][key_type])[1]
+
+
+def buffer_size(schema, direction):
+    '''worst case: every key bound that way in a single dictionary, except
+    that a key marked alone only ever travels with those in its "with"'''
+    keys = [key for key in sorted_keys(schema) if key['to'] == direction]
+    size = lambda key: TUPLE_HEADER_SIZE + tuple_size(schema, key['type'])
+    sizes = [size(key) for key in keys if not key.get('alone')]
+    worst = DICT_HEADER_SIZE + sum(sizes)
+    for key in keys:
+        if key.get('alone'):
+            alone = [size(key)] + [size(dict(schema['keys'][name], name=name))
+                                   for name in key.get('with', [])]
+            if DICT_HEADER_SIZE + sum(alone) > worst:
+                worst, sizes = DICT_HEADER_SIZE + sum(alone), alone
+    return worst, sizes
+
+
+def sorted_keys(schema):
+    keys = []
+    for name, key in schema['keys'].items():
+        key = dict(key)
+        key['name'] = name
+        keys.append(key)
+    return sorted(keys, key=lambda key: key['id'])
+
+
+def camel(name):
+    return ''.join(part.capitalize() for part in name.split('_'))
+
+
+def c_type(field_type):
+    if field_type == 'char':
+        return 'char'
+    return field_type + '_t'
+
+
+def render_c(schema):
+    # only fixed width types, so the worker can use it next to
+    # pebble_worker.h
+    out = ['#pragma once', '',
+           '// generated by tools/schema.py from messages.json; do not edit',
+           '', '#include <stdint.h>', '']
+
+    for key in sorted_keys(schema):
+        out.append('#define {:<31} {}'.format(key['name'], key['id']))
+    out.append('')
+
+    for name, value in sorted(schema.get('constants', {}).items()):
+        out.append('#define {:<31} {}'.format(name, value))
+    out.append('')
+
+    out.append('// value a field holds when the phone had nothing for it')
+    for field_type, (width, signed) in sorted(TYPES.items()):
+        if field_type == 'char':
+            continue
+        limit = '{}INT{}_{}'.format('' if signed else 'U', width * 8,
+                                    'MIN' if signed else 'MAX')
+        out.append('#define {:<31} {}'.format(
+            'UNKNOWN_' + field_type.upper(), limit))
+    out.append('')
+
+    for enum_name, enum in sorted(schema['enums'].items()):
+        for index, value in enumerate(enum['values']):
+            name = '{}_{}'.format(enum_name, value.upper())
+            if enum.get('bits'):
+                out.append('#define {:<31} (1 << {})'.format(name, index))
+            else:
+                out.append('#define {:<31} {}'.format(name, index))
+        if not enum.get('bits'):
+            out.append('#define {:<31} {}'.format(enum_name + '_COUNT',
+                                                  len(enum['values'])))
+            out.append('#define {}_NAMES {{ \\'.format(enum_name))
+            for value in enum['values']:
+                out.append('        "{}", \\'.format(value))
+            out.append('}')
+        out.append('')
+
+    for struct_name, struct in sorted(schema['structs'].items()):
+        fields, size = layout(struct)
+        type_name = camel(struct_name) + 'Message'
+        if struct.get('doc'):
+            out.append('// ' + struct['doc'])
+        out.append('typedef struct __attribute__((__packed__)) {} {{'.format(
+            type_name))
+        for name, field_type, offset, count, group in fields:
+            suffix = '[{}]'.format(count) if count > 1 else ''
+            out.append('        {} {}{};'.format(c_type(field_type), name,
+                                                suffix))
+        out.append('}} {};'.format(type_name))
+        out.append('')
+        out.append('#define {:<31} {}'.format(
+            struct_name.upper() + '_MESSAGE_SIZE', size))
+        out.append('')
+
+    for direction, name in (('watch', 'APP_MESSAGE_IN_SIZE'),
+                            ('phone', 'APP_MESSAGE_OUT_SIZE')):
+        size, sizes = buffer_size(schema, direction)
+        breakdown = ' + '.join([str(DICT_HEADER_SIZE)]
+                               + [str(s) for s in sizes])
+        out.append('#define {:<31} {:<6} // {}'.format(name, size, breakdown))
+    out.append('')
+
+    return '\n'.join(out)
+
+
+def render_js(schema):
+    out = [JS_BEGIN]
+
+    for key in sorted_keys(schema):
+        out.append("const {} = '{}';".format(key['name'], key['name']))
+    out.append('')
+
+    for name, value in sorted(schema.get('constants', {}).items()):
+        out.append('const {} = {};'.format(name, value))
+    out.append('')
+
+    for enum_name, enum in sorted(schema['enums'].items()):
+        if enum.get('bits'):
+            pairs = ['{}: {}'.format(value, 1 << index)
+                     for index, value in enumerate(enum['values'])]
+            out.append('const {} = {{{}}};'.format(enum_name, ', '.join(pairs)))
+        else:
+            values = ["'{}'".format(value) for value in enum['values']]
+            out.append('const {} = [{}];'.format(enum_name, ', '.join(values)))
+    out.append('')
+
+    for struct_name, struct in sorted(schema['structs'].items()):
+        fields, size = layout(struct)
+        prefix = struct_name.upper()
+        out.append('// [name, type, offset, count, present group]')
+        out.append('const {}_FIELDS = ['.format(prefix))
+        for name, field_type, offset, count, group in fields:
+            out.append("    ['{}', '{}', {}, {}, {}],".format(
+                name, field_type, offset, count,
+                "'{}'".format(group) if group else 'null'))
+        out.append('];')
+        out.append('const {}_SIZE = {};'.format(prefix, size))
+        out.append('')
+
+    out[-1] = JS_END
+    return '\n'.join(out)
+
+
+def patch_appinfo(text, schema):
+    keys = ['    "{}": {}'.format(key['name'], key['id'])
+            for key in sorted_keys(schema)]
+    block = '"appKeys": {\n' + ',\n'.join(keys) + '\n  }'
+    return re.sub(r'"appKeys":\s*\{[^}]*\}', lambda m: block, text, count=1)
+
+
+def patch_js(text, schema):
+    start = text.index(JS_BEGIN)
+    end = text.index(JS_END) + len(JS_END)
+    return text[:start] + render_js(schema) + text[end:]
+
+
+def outputs(root, schema):
+    '''yields (path, new contents) for every generated file'''
+    yield os.path.join(root, 'src', 'messages.auto.h'), render_c(schema)
+
+    for name, patch in (('appinfo.json', patch_appinfo),
+                        (os.path.join('src', 'js', 'pebble-js-app.js'),
+                         patch_js)):
+        path = os.path.join(root, name)
+        with open(path) as f:
+            yield path, patch(f.read(), schema)
+
+
+def generate(root=ROOT, check=False):
+    '''returns the list of files that were (or, with check, would be)
+    rewritten'''
+    schema = load(root)
+    stale = []
+    for path, contents in outputs(root, schema):
+        current = None
+        if os.path.exists(path):
+            with open(path) as f:
+                current = f.read()
+        if current != contents:
+            stale.append(path)
+            if not check:
+                with open(path, 'w') as f:
+                    f.write(contents)
+    return stale
+
+
+if __name__ == '__main__':
+    check = '--check' in sys.argv[1:]
+    stale = generate(check=check)
+    for path in stale:
+        print('{} {}'.format('stale' if check else 'wrote',
+                             os.path.relpath(path, ROOT)))
+    sys.exit(1 if check and stale else 0)
@@ -0,0 +1,121 @@
+#include <pebble_worker.h>
+#include "../src/shared.h"
+
+// Runs while the face is closed.  It holds the refresh schedule the face
+// hands over as it closes.  When the face opens again it gets that, with
+// the tide height and whether the weather has gone stale worked out from
+// the caches the face saved, instead of starting over.  Nothing needs it in
+// between, so it only wakes for messages.
+
+static TidesMessage s_tides;
+static time_t s_weather_fetched;        // 0 until the face has saved some
+
+static int16_t s_height_cm = UNKNOWN_INT16;
+static int s_next = -1;
+static bool s_stale;
+
+static bool s_scheduled;                // the face has handed over
+static time_t s_next_refresh;
+static uint16_t s_refresh_failures;
+static uint16_t s_wind_change_dkt;
+
+int main(void);
+static void init();
+static void deinit();
+static void read_caches();
+static void update_snapshot();
+static void send_snapshot();
+static void message_handler(uint16_t, AppWorkerMessage *);
+
+// at launch and when the face says it has saved, not on every hello
+static void read_caches()
+{
+        WeatherCache weather;
+        TideCache tides;
+
+        if ( persist_read_data(KEY_WEATHER_CACHE, &weather, sizeof(weather))
+             == (int)sizeof(weather) )
+                s_weather_fetched = weather.fetched;
+
+        if ( persist_read_data(KEY_TIDE_CACHE, &tides, sizeof(tides))
+             == (int)sizeof(tides)
+             && tides.tides.count <= ARRAY_LENGTH(tides.tides.offset_min) )
+                s_tides = tides.tides;
+}
+
+static void update_snapshot()
+{
+        time_t now = time(NULL);
+
+        s_next = tide_next(&s_tides, now);
+        s_height_cm = s_next < 0 ? UNKNOWN_INT16
+                                 : tide_height_cm(&s_tides, s_next, now);
+        s_stale = s_weather_fetched != 0
+                && now - s_weather_fetched > STALE_AFTER_S;
+}
+
+// to the face, if it's open to hear it
+static void send_snapshot()
+{
+        time_t now = time(NULL);
+
+        update_snapshot();
+        AppWorkerMessage snapshot = {
+                .data0 = (uint16_t)s_height_cm,
+                .data1 = s_next < 0 ? WORKER_NO_TIDE : s_next,
+                .data2 = s_stale ? WORKER_STALE : 0,
+        };
+
+        app_worker_send_message(WORKER_SNAPSHOT, &snapshot);
+
+        if ( !s_scheduled )
+                return;
+
+        AppWorkerMessage schedule = {
+                .data0 = s_next_refresh > now
+                         ? (s_next_refresh - now + 59) / 60 : 0,
+                .data1 = s_refresh_failures,
+                .data2 = s_wind_change_dkt,
+        };
+        app_worker_send_message(WORKER_SCHEDULE, &schedule);
+}
+
+static void message_handler(uint16_t type, AppWorkerMessage *data)
+{
+        switch ( type )
+        {
+        case WORKER_HELLO:
+                send_snapshot();
+                break;
+        case WORKER_SCHEDULE:
+                s_scheduled = true;
+                s_next_refresh = time(NULL) + data->data0 * 60;
+                s_refresh_failures = data->data1;
+                s_wind_change_dkt = data->data2;
+
+                // the face saves as things arrive, and this comes last
+                read_caches();
+                break;
+        }
+}
+
+static void init()
+{
+        read_caches();
+        app_worker_message_subscribe(message_handler);
+
+        // the face launched us and may already have said hello
+        send_snapshot();
+}
+
+static void deinit()
+{
+        app_worker_message_unsubscribe();
+}
+
+int main(void)
+{
+        init();
+        worker_event_loop();
+        deinit();
+}